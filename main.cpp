@@ -1,5 +1,6 @@
 #include <SFML/Graphics.hpp>
 #include <SFML/Audio.hpp>
+#include <SFML/OpenGL.hpp>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -11,16 +12,64 @@
 #include <iostream>
 #include <random>
 #include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <array>
+#include <unordered_map>
+#include <type_traits>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cctype>
+#include <cstdarg>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <limits>
+#include <csignal>
+#include <cerrno>
+#include <exception>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <dirent.h>
+#include <malloc.h>
+#include <unistd.h>
+#define SHAOLIN_HAS_PROCFS 1
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#define SHAOLIN_HAS_MALLINFO2 1
+#endif
+#endif
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SHAOLIN_HAS_SSE2 1
+#endif
 
 const std::string RESOURCES_DIR = "D:\\++\\ShaolinNumber2\\resources\\";
 const std::string SAVE_FILE = RESOURCES_DIR + "save.dat";
+const std::string PROFILES_FILE = RESOURCES_DIR + "profiles.dat";
+const std::string DEFAULT_PROFILE = "player";
 const std::string CONFIG_FILE = RESOURCES_DIR + "config.cfg";
+const std::string METRICS_FILE = RESOURCES_DIR + "metrics.prom";
+const std::string FLIGHT_LOG_FILE = RESOURCES_DIR + "flight.log";
+const std::string CRASH_FILE = RESOURCES_DIR + "crash.log";
+const std::string SOAK_REPORT_FILE = "soak.csv";
+const std::string DEFAULT_MUSIC = "garmoniya-in-yan-278.mp3";
 
 class Config {
 public:
     int width = 800;
     int height = 600;
     bool fullscreen = false;
+    float uiVolume = 100.f;
+    float gameVolume = 100.f;
 
     void load() {
         std::ifstream file(CONFIG_FILE);
@@ -29,222 +78,4318 @@ public:
             // Validate values
             width = std::max(640, std::min(width, 1920));
             height = std::max(480, std::min(height, 1080));
+
+            // Sound-effect volumes, missing from older config files
+            float ui, game;
+            if (file >> ui >> game) {
+                uiVolume = std::max(0.f, std::min(ui, 100.f));
+                gameVolume = std::max(0.f, std::min(game, 100.f));
+            }
+        }
+    }
+
+    void save() {
+        std::ofstream file(CONFIG_FILE);
+        if (file) {
+            file << width << " " << height << " " << fullscreen << " " << uiVolume << " " << gameVolume;
+        }
+    }
+};
+
+inline sf::Int64 nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Monotonic counter, safe to bump from any thread with a single relaxed add
+class MetricCounter {
+public:
+    void add(std::uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    std::uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::uint64_t> value{ 0 };
+};
+
+// Fixed-bucket histogram. Values are recorded as integers in the caller's unit
+// (microseconds, guesses...) and multiplied by scale on export.
+class MetricHistogram {
+public:
+    MetricHistogram(const std::vector<std::int64_t>& upperBounds, double scale)
+        : bounds(upperBounds), buckets(new std::atomic<std::uint64_t>[upperBounds.size() + 1]), scale(scale) {
+        for (std::size_t i = 0; i <= bounds.size(); ++i) buckets[i].store(0, std::memory_order_relaxed);
+    }
+
+    void observe(std::int64_t value) {
+        std::size_t i = 0;
+        while (i < bounds.size() && value > bounds[i]) ++i;
+        buckets[i].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void write(std::ostream& out, const std::string& name, const std::string& labels) const {
+        std::string prefix = labels.empty() ? "{" : "{" + labels + ",";
+        std::uint64_t cumulative = 0;
+        for (std::size_t i = 0; i < bounds.size(); ++i) {
+            cumulative += buckets[i].load(std::memory_order_relaxed);
+            out << name << "_bucket" << prefix << "le=\"" << bounds[i] * scale << "\"} " << cumulative << "\n";
+        }
+        cumulative += buckets[bounds.size()].load(std::memory_order_relaxed);
+        out << name << "_bucket" << prefix << "le=\"+Inf\"} " << cumulative << "\n";
+        std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+        out << name << "_sum" << suffix << " " << sum.load(std::memory_order_relaxed) * scale << "\n";
+        out << name << "_count" << suffix << " " << cumulative << "\n";
+    }
+
+private:
+    std::vector<std::int64_t> bounds;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> buckets;
+    std::atomic<std::int64_t> sum{ 0 };
+    double scale;
+};
+
+// Process-wide metric registry. Registration and export take a lock, recording
+// goes straight to the metric's atomics.
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    MetricCounter& counter(const std::string& name, const std::string& help, const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mutex);
+        Series& series = addSeries(name, help, "counter", labels);
+        series.counter.reset(new MetricCounter());
+        return *series.counter;
+    }
+
+    MetricHistogram& histogram(const std::string& name, const std::string& help,
+        const std::vector<std::int64_t>& bounds, double scale, const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mutex);
+        Series& series = addSeries(name, help, "histogram", labels);
+        series.histogram.reset(new MetricHistogram(bounds, scale));
+        return *series.histogram;
+    }
+
+    // Prometheus text exposition format, version 0.0.4
+    void write(std::ostream& out) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& family : families) {
+            out << "# HELP " << family->name << " " << family->help << "\n";
+            out << "# TYPE " << family->name << " " << family->type << "\n";
+            for (const auto& series : family->series) {
+                if (series->counter) {
+                    out << family->name << (series->labels.empty() ? "" : "{" + series->labels + "}")
+                        << " " << series->counter->get() << "\n";
+                }
+                else {
+                    series->histogram->write(out, family->name, series->labels);
+                }
+            }
+        }
+    }
+
+private:
+    struct Series {
+        std::string labels;
+        std::unique_ptr<MetricCounter> counter;
+        std::unique_ptr<MetricHistogram> histogram;
+    };
+    struct Family {
+        std::string name;
+        std::string help;
+        std::string type;
+        std::vector<std::unique_ptr<Series>> series;
+    };
+
+    Series& addSeries(const std::string& name, const std::string& help, const std::string& type, const std::string& labels) {
+        auto it = std::find_if(families.begin(), families.end(),
+            [&](const std::unique_ptr<Family>& f) { return f->name == name; });
+        if (it == families.end()) {
+            families.emplace_back(new Family{ name, help, type, {} });
+            it = families.end() - 1;
+        }
+        (*it)->series.emplace_back(new Series());
+        (*it)->series.back()->labels = labels;
+        return *(*it)->series.back();
+    }
+
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<Family>> families;
+};
+
+// Everything that differs between difficulties, indexed by NumberGuesser::Difficulty.
+// Screens, metrics and the specialized game kernels all read it from here.
+struct DifficultyRules {
+    const char* name;
+    const char* label;      // metric label value
+    int range;
+    int maxAttempts;        // 0 = unlimited
+    int timeLimitSeconds;   // 0 = no timer
+    int points;
+};
+
+const int DIFFICULTY_COUNT = 5;
+constexpr DifficultyRules DIFFICULTY_RULES[DIFFICULTY_COUNT] = {
+    { "Easy", "easy", 50, 0, 0, 10 },
+    { "Medium", "medium", 100, 15, 0, 25 },
+    { "Hard", "hard", 200, 10, 0, 50 },
+    { "Expert", "expert", 500, 7, 120, 100 },
+    { "Master", "master", 1000, 5, 60, 200 }
+};
+
+// The game's metrics, registered once on first use
+struct Telemetry {
+    static const int QUALITY_LEVELS = 4;
+
+    MetricHistogram* frameTime;
+    MetricHistogram* guessesPerGame;
+    MetricHistogram* timeToWin;
+    MetricHistogram* saveLatency;
+    MetricHistogram* assetLoad;
+    MetricHistogram* inputToCommand;
+    MetricHistogram* inputToPresent;
+    MetricHistogram* musicBuffered;
+    MetricCounter* musicUnderruns;
+    MetricHistogram* sfxVoices;
+    MetricCounter* sfxSteals;
+    MetricCounter* sfxDropped;
+    std::array<MetricCounter*, DIFFICULTY_COUNT> gamesStarted;
+    std::array<MetricCounter*, DIFFICULTY_COUNT> gamesWon;
+    std::array<MetricCounter*, DIFFICULTY_COUNT> gamesLost;
+    std::array<MetricCounter*, QUALITY_LEVELS> qualityFrames;
+
+    static Telemetry& get() {
+        static Telemetry telemetry;
+        return telemetry;
+    }
+
+private:
+    Telemetry() {
+        MetricsRegistry& registry = MetricsRegistry::instance();
+        const double MICROS = 1e-6;
+        frameTime = &registry.histogram("shaolin_frame_seconds", "Time between presented frames.",
+            { 4000, 8000, 12000, 16667, 20000, 33333, 50000, 100000 }, MICROS);
+        guessesPerGame = &registry.histogram("shaolin_guesses_per_game", "Guesses made in a finished game.",
+            { 1, 2, 3, 5, 7, 10, 15, 20, 30, 50 }, 1.0);
+        timeToWin = &registry.histogram("shaolin_time_to_win_seconds", "Game time from start to a correct guess.",
+            { 5000000, 10000000, 20000000, 30000000, 60000000, 120000000, 300000000 }, MICROS);
+        saveLatency = &registry.histogram("shaolin_save_seconds", "Time spent writing the save file.",
+            { 100, 500, 1000, 5000, 10000, 50000 }, MICROS);
+        assetLoad = &registry.histogram("shaolin_asset_load_seconds", "Time spent loading a font, texture or sound.",
+            { 1000, 5000, 10000, 50000, 100000, 500000 }, MICROS);
+        inputToCommand = &registry.histogram("shaolin_input_to_command_seconds",
+            "Time from receiving a click or key event to executing the command it issued.",
+            { 1000, 2000, 4000, 8000, 16667, 33333, 50000, 100000 }, MICROS);
+        inputToPresent = &registry.histogram("shaolin_input_to_present_seconds",
+            "Time from receiving a click or key event to displaying the frame that shows its result.",
+            { 4000, 8000, 16667, 25000, 33333, 50000, 66667, 100000, 200000 }, MICROS);
+        musicBuffered = &registry.histogram("shaolin_music_buffer_seconds",
+            "Decoded music ahead of playback, sampled at every mix.",
+            { 50, 100, 250, 500, 1000, 2000, 3000 }, 1e-3);
+        musicUnderruns = &registry.counter("shaolin_music_underruns_total",
+            "Mixes that found the playing track's decode-ahead buffer empty.", "");
+        sfxVoices = &registry.histogram("shaolin_sfx_active_voices",
+            "Sound-effect voices playing, sampled each time a sound starts.", { 1, 2, 4, 6, 8, 12 }, 1.0);
+        sfxSteals = &registry.counter("shaolin_sfx_steals_total",
+            "Sound effects that cut off a lower- or equal-priority sound to get a voice.", "");
+        sfxDropped = &registry.counter("shaolin_sfx_dropped_total",
+            "Sound effects dropped because every voice held a higher-priority sound.", "");
+
+        for (int i = 0; i < DIFFICULTY_COUNT; ++i) {
+            std::string label = std::string("difficulty=\"") + DIFFICULTY_RULES[i].label + "\"";
+            gamesStarted[i] = &registry.counter("shaolin_games_started_total", "Games started.", label);
+            gamesWon[i] = &registry.counter("shaolin_games_won_total", "Games won.", label);
+            gamesLost[i] = &registry.counter("shaolin_games_lost_total", "Games lost.", label);
+        }
+
+        static const char* levels[QUALITY_LEVELS] = { "full", "reduced", "low", "minimal" };
+        for (int i = 0; i < QUALITY_LEVELS; ++i) {
+            std::string label = std::string("level=\"") + levels[i] + "\"";
+            qualityFrames[i] = &registry.counter("shaolin_quality_frames_total",
+                "Frames presented at each quality level of the frame-time governor.", label);
+        }
+    }
+};
+
+// Always-on record of the last few thousand things the game did, kept in a
+// fixed ring so a crash report can show what led up to it. Any thread may
+// record: a slot is claimed with one atomic increment and guarded by its own
+// busy flag, so writers never wait on each other or on a reader. A writer
+// that finds its slot busy marks its sequence as skipped, so readers report
+// it lost instead of waiting for it.
+class FlightRecorder {
+public:
+    static const std::size_t CAPACITY = 4096;
+    static const std::size_t TEXT_SIZE = 40;
+
+    enum Kind { STATE, GUESS, COMMAND, ASSET, SAVE, FRAME, FAILURE };
+
+    struct Event {
+        std::uint64_t sequence;
+        sf::Int64 stamp;        // microseconds since startup
+        Kind kind;
+        std::int64_t a;
+        std::int64_t b;
+        char text[TEXT_SIZE];
+    };
+
+    static FlightRecorder& get() {
+        static FlightRecorder recorder;
+        return recorder;
+    }
+
+    // The text is copied, truncated and stripped of characters that would
+    // need escaping in the log
+    void record(Kind kind, const char* text, std::int64_t a = 0, std::int64_t b = 0) {
+        std::uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = slots[index % CAPACITY];
+        if (slot.busy.exchange(true, std::memory_order_acquire)) {
+            std::uint64_t skipped = slot.skipped.load(std::memory_order_relaxed);
+            while (skipped < index + 1 && !slot.skipped.compare_exchange_weak(skipped, index + 1, std::memory_order_release)) {
+            }
+            return;
+        }
+
+        Event& event = slot.event;
+        event.sequence = index;
+        event.stamp = nowMicros() - origin;
+        event.kind = kind;
+        event.a = a;
+        event.b = b;
+        std::size_t i = 0;
+        for (; text && text[i] && i < TEXT_SIZE - 1; ++i) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            event.text[i] = (c < 0x20 || c >= 0x7f || c == '"' || c == '\\') ? '?' : static_cast<char>(c);
+        }
+        event.text[i] = '\0';
+
+        slot.written.store(index + 1, std::memory_order_relaxed);
+        slot.busy.store(false, std::memory_order_release);
+    }
+
+    enum ReadResult { COPIED, PENDING, OVERWRITTEN };
+
+    // Copies the event with the given sequence number if its slot still holds it
+    ReadResult read(std::uint64_t sequence, Event& out) {
+        Slot& slot = slots[sequence % CAPACITY];
+        if (slot.busy.exchange(true, std::memory_order_acquire)) return PENDING;
+        std::uint64_t written = slot.written.load(std::memory_order_relaxed);
+        ReadResult result = written == sequence + 1 ? COPIED : written > sequence + 1 ? OVERWRITTEN : PENDING;
+        if (result == COPIED) out = slot.event;
+        slot.busy.store(false, std::memory_order_release);
+        if (result == PENDING && slot.skipped.load(std::memory_order_acquire) >= sequence + 1) return OVERWRITTEN;
+        return result;
+    }
+
+    std::uint64_t recorded() const { return head.load(std::memory_order_acquire); }
+
+    static const char* kindName(Kind kind) {
+        static const char* names[] = { "state", "guess", "command", "asset", "save", "frame", "failure" };
+        return names[kind];
+    }
+
+    // One JSON object per line; returns the length written. Formats by hand
+    // rather than through snprintf so the crash handlers can call it.
+    static int format(const Event& event, char* out, std::size_t size) {
+        Line line(out, size);
+        line.append("{\"seq\":").append(event.sequence).append(",\"t\":").append(static_cast<std::int64_t>(event.stamp))
+            .append(",\"kind\":\"").append(kindName(event.kind)).append("\",\"text\":\"").append(event.text)
+            .append("\",\"a\":").append(event.a).append(",\"b\":").append(event.b).append("}\n");
+        return static_cast<int>(line.length);
+    }
+
+    // Writes the whole ring over the crash file, once per run. Called from the
+    // terminate handler and fatal signal handlers, so it sticks to calls that
+    // are async-signal-safe: records are formatted into a stack buffer and
+    // written to the descriptor opened by installCrashHandlers. A slot a
+    // crashed thread left busy is skipped.
+    void dumpCrash(const char* reason) {
+        if (dumped.exchange(true) || crashFile < 0) return;
+
+        char buffer[256];
+        std::uint64_t end = recorded();
+        std::uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+        Line header(buffer, sizeof(buffer));
+        header.append("{\"crash\":\"").append(reason).append("\",\"t\":").append(static_cast<std::int64_t>(nowMicros() - origin))
+            .append(",\"events\":").append(end - begin).append("}\n");
+        std::int64_t written = writeAll(crashFile, buffer, header.length);
+
+        Event event;
+        for (std::uint64_t i = begin; i < end; ++i) {
+            if (read(i, event) != COPIED) continue;
+            int length = format(event, buffer, sizeof(buffer));
+            written += writeAll(crashFile, buffer, static_cast<std::size_t>(length));
+        }
+        // Cuts off whatever was left of a longer report from an earlier run
+#if defined(_WIN32)
+        _chsize_s(crashFile, written);
+        _close(crashFile);
+#else
+        ::ftruncate(crashFile, static_cast<off_t>(written));
+        ::close(crashFile);
+#endif
+        crashFile = -1;
+
+        Line notice(buffer, sizeof(buffer));
+        notice.append("Crash report written to ").append(crashPath).append("\n");
+        writeAll(2, buffer, notice.length);
+    }
+
+    // Dumps the ring on std::terminate and on fatal signals, then lets the
+    // default handling run. The path must outlive the process. The file is
+    // opened here, since a signal handler may not open one; it is created
+    // empty if missing and keeps an earlier crash report until the next dump.
+    void installCrashHandlers(const char* path) {
+        crashPath = path;
+#if defined(_WIN32)
+        crashFile = _open(path, _O_WRONLY | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        crashFile = ::open(path, O_WRONLY | O_CREAT, 0644);
+#endif
+        if (crashFile < 0) {
+            std::cerr << "Warning: cannot open " << path << ", crash reports are disabled" << std::endl;
+        }
+        std::set_terminate([]() {
+            const char* reason = "terminate";
+            try {
+                if (std::exception_ptr current = std::current_exception()) std::rethrow_exception(current);
+            }
+            catch (const std::exception& e) {
+                FlightRecorder::get().record(FAILURE, e.what());
+                reason = "uncaught exception";
+            }
+            catch (...) {
+                reason = "uncaught exception";
+            }
+            FlightRecorder::get().dumpCrash(reason);
+            std::abort();
+        });
+        for (int fatal : { SIGSEGV, SIGABRT, SIGFPE, SIGILL }) {
+            std::signal(fatal, [](int number) {
+                FlightRecorder::get().record(FAILURE, "signal", number);
+                FlightRecorder::get().dumpCrash("fatal signal");
+                std::signal(number, SIG_DFL);
+                std::raise(number);
+            });
+        }
+    }
+
+private:
+    FlightRecorder() : origin(nowMicros()) {}
+
+    // Appends text and decimal numbers to a fixed buffer, truncating, and
+    // keeps it null-terminated
+    struct Line {
+        char* out;
+        std::size_t size;
+        std::size_t length = 0;
+
+        Line(char* out, std::size_t size) : out(out), size(size) { out[0] = '\0'; }
+
+        Line& append(const char* text) {
+            while (*text && length + 1 < size) out[length++] = *text++;
+            out[length] = '\0';
+            return *this;
+        }
+        Line& append(std::uint64_t value) {
+            char digits[21];
+            std::size_t count = sizeof(digits) - 1;
+            digits[count] = '\0';
+            do {
+                digits[--count] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value > 0);
+            return append(digits + count);
+        }
+        Line& append(std::int64_t value) {
+            if (value < 0) append("-");
+            return append(value < 0 ? 0 - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value));
+        }
+    };
+
+    // Returns the bytes written, which fall short only if the write fails
+    static std::int64_t writeAll(int file, const char* data, std::size_t size) {
+        std::size_t done = 0;
+        while (done < size) {
+#if defined(_WIN32)
+            int result = _write(file, data + done, static_cast<unsigned>(size - done));
+#else
+            ssize_t result = ::write(file, data + done, size - done);
+            if (result < 0 && errno == EINTR) continue;
+#endif
+            if (result <= 0) break;
+            done += static_cast<std::size_t>(result);
+        }
+        return static_cast<std::int64_t>(done);
+    }
+
+    struct Slot {
+        std::atomic<bool> busy{ false };
+        std::atomic<std::uint64_t> written{ 0 };    // sequence + 1 of the event held, 0 if none
+        std::atomic<std::uint64_t> skipped{ 0 };    // sequence + 1 of the newest writer that found it busy
+        Event event;
+    };
+
+    sf::Int64 origin;
+    std::atomic<std::uint64_t> head{ 0 };
+    std::atomic<bool> dumped{ false };
+    const char* crashPath = "crash.log";
+    int crashFile = -1;
+    std::array<Slot, CAPACITY> slots;
+};
+
+// Appends the flight recorder's events to a log file on its own thread, so
+// recording never touches the disk. Events overwritten before it got to them
+// are reported as a gap. The previous run's log, and the file whenever it
+// grows large, roll over to path + ".1".
+class FlightLogWriter {
+public:
+    static const std::streamoff MAX_BYTES = 4 * 1024 * 1024;
+
+    FlightLogWriter(const std::string& path, std::chrono::milliseconds interval)
+        : path(path), interval(interval), file(rollOver(path), std::ios::trunc), worker(&FlightLogWriter::loop, this) {
+    }
+
+    ~FlightLogWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+        drain();
+    }
+
+private:
+    // Moves the log at path aside and returns path for a fresh one
+    static const std::string& rollOver(const std::string& path) {
+        std::string previous = path + ".1";
+        std::remove(previous.c_str());
+        std::rename(path.c_str(), previous.c_str());
+        return path;
+    }
+
+    void loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, interval, [this]() { return stopping; })) {
+            lock.unlock();
+            drain();
+            lock.lock();
+        }
+    }
+
+    void drain() {
+        if (!file) return;
+        FlightRecorder& recorder = FlightRecorder::get();
+        std::uint64_t end = recorder.recorded();
+        std::uint64_t lost = 0;
+        if (end - next > FlightRecorder::CAPACITY) {
+            lost = end - next - FlightRecorder::CAPACITY;
+            next = end - FlightRecorder::CAPACITY;
+        }
+
+        char line[256];
+        FlightRecorder::Event event;
+        for (; next < end; ++next) {
+            FlightRecorder::ReadResult result = recorder.read(next, event);
+            // Still being written: pick it up on the next pass
+            if (result == FlightRecorder::PENDING) break;
+            if (result == FlightRecorder::OVERWRITTEN) {
+                ++lost;
+                continue;
+            }
+            int length = FlightRecorder::format(event, line, sizeof(line));
+            if (length > 0) file.write(line, std::min(static_cast<std::streamsize>(length), static_cast<std::streamsize>(sizeof(line) - 1)));
+        }
+        if (lost > 0) file << "{\"kind\":\"gap\",\"lost\":" << lost << "}\n";
+        file.flush();
+
+        if (file.tellp() > MAX_BYTES) {
+            file.close();
+            file.open(rollOver(path), std::ios::trunc);
+        }
+    }
+
+    std::string path;
+    std::chrono::milliseconds interval;
+    std::ofstream file;
+    std::uint64_t next = 0;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread worker;
+};
+
+// Records the lifetime of the enclosing scope into a histogram, in
+// microseconds, and optionally as a flight recorder event
+class ScopedMetricTimer {
+public:
+    explicit ScopedMetricTimer(MetricHistogram* histogram) : histogram(histogram), start(nowMicros()) {}
+    ScopedMetricTimer(MetricHistogram* histogram, FlightRecorder::Kind kind, const char* event)
+        : histogram(histogram), event(event), kind(kind), start(nowMicros()) {
+    }
+    ~ScopedMetricTimer() {
+        sf::Int64 elapsed = nowMicros() - start;
+        histogram->observe(elapsed);
+        if (event) FlightRecorder::get().record(kind, event, elapsed);
+    }
+
+private:
+    MetricHistogram* histogram;
+    const char* event = nullptr;
+    FlightRecorder::Kind kind = FlightRecorder::ASSET;
+    sf::Int64 start;
+};
+
+// Rewrites the metrics file on its own thread so a local scraper (e.g. the
+// node_exporter textfile collector) can pick it up. The file is replaced
+// via a rename so readers never see a partial write.
+class MetricsExporter {
+public:
+    MetricsExporter(const std::string& path, std::chrono::milliseconds interval)
+        : path(path), interval(interval), worker(&MetricsExporter::loop, this) {
+    }
+
+    ~MetricsExporter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+        flush();
+    }
+
+    void flush() const {
+        std::string temp = path + ".tmp";
+        {
+            std::ofstream file(temp, std::ios::trunc);
+            if (!file) return;
+            MetricsRegistry::instance().write(file);
+        }
+        std::remove(path.c_str());
+        if (std::rename(temp.c_str(), path.c_str()) != 0) {
+            std::cerr << "Failed to write metrics file " << path << std::endl;
+        }
+    }
+
+private:
+    void loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, interval, [this]() { return stopping; })) {
+            lock.unlock();
+            flush();
+            lock.lock();
+        }
+    }
+
+    std::string path;
+    std::chrono::milliseconds interval;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread worker;
+};
+
+// Counts heap allocations made through the global operator new, per thread,
+// and attributes them to the innermost AllocationScope. Everything here is
+// plain data, so recording an allocation never allocates.
+class AllocationTracker {
+public:
+    static const int MAX_SITES = 32;
+
+    struct Site {
+        const char* name;
+        std::uint64_t allocations;
+        std::uint64_t bytes;
+    };
+
+    struct Counters {
+        std::uint64_t allocations;
+        std::uint64_t bytes;
+        const char* scope;
+        int siteCount;
+        Site sites[MAX_SITES];
+    };
+
+    static Counters& local() {
+        static thread_local Counters counters = {};
+        return counters;
+    }
+
+    static void record(std::size_t size) {
+        Counters& counters = local();
+        ++counters.allocations;
+        counters.bytes += size;
+
+        const char* scope = counters.scope ? counters.scope : "(unscoped)";
+        for (int i = 0; i < counters.siteCount; ++i) {
+            if (counters.sites[i].name == scope) {
+                ++counters.sites[i].allocations;
+                counters.sites[i].bytes += size;
+                return;
+            }
+        }
+        if (counters.siteCount < MAX_SITES) {
+            counters.sites[counters.siteCount++] = { scope, 1, size };
+        }
+    }
+
+    // Starts a new attribution window, e.g. one frame
+    static void resetSites() { local().siteCount = 0; }
+
+    static void reportSites(std::ostream& out) {
+        const Counters& counters = local();
+        for (int i = 0; i < counters.siteCount; ++i) {
+            out << "  " << counters.sites[i].name << ": " << counters.sites[i].allocations
+                << " allocations, " << counters.sites[i].bytes << " bytes" << std::endl;
+        }
+    }
+};
+
+// Attributes allocations on this thread to a named call site while alive.
+// The name must be a string literal, sites are told apart by address.
+class AllocationScope {
+public:
+    explicit AllocationScope(const char* name) : previous(AllocationTracker::local().scope) {
+        AllocationTracker::local().scope = name;
+    }
+    ~AllocationScope() { AllocationTracker::local().scope = previous; }
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+private:
+    const char* previous;
+};
+
+// Timeline of named zones, exported as Chrome trace-event JSON for Perfetto
+// or chrome://tracing. Always compiled in: while disabled a zone costs one
+// relaxed load of the flag on entry and a null test on exit. Each thread
+// records into a ring only it writes, so recording takes no lock and a long
+// session keeps its latest EVENTS_PER_THREAD zones; the registry lock is taken
+// once per thread, when its first zone is recorded.
+class Tracer {
+public:
+    static const std::size_t EVENTS_PER_THREAD = 1 << 16;
+
+    static bool enabled() { return flag().load(std::memory_order_relaxed); }
+    static void setEnabled(bool on) { flag().store(on, std::memory_order_relaxed); }
+
+    // Track name for the calling thread; call before its first zone
+    static void nameThread(const char* name) { threadName() = name; }
+
+    static void record(const char* name, sf::Int64 start, sf::Int64 end) {
+        Buffer* buffer = local();
+        if (!buffer) buffer = attach();
+        std::uint64_t count = buffer->count.load(std::memory_order_relaxed);
+        buffer->events[count % EVENTS_PER_THREAD] = { name, start, end - start };
+        buffer->count.store(count + 1, std::memory_order_release);
+    }
+
+    // For exit, once the threads that record have stopped: a ring that is
+    // still being written may overwrite events while they are exported
+    static bool writeChromeJson(const std::string& path) {
+        std::ofstream file(path);
+        if (!file) return false;
+
+        std::lock_guard<std::mutex> lock(registryMutex());
+        std::vector<std::unique_ptr<Buffer>>& buffers = registry();
+        sf::Int64 origin = std::numeric_limits<sf::Int64>::max();
+        for (const std::unique_ptr<Buffer>& buffer : buffers) {
+            std::uint64_t count = buffer->count.load(std::memory_order_acquire);
+            for (std::uint64_t i = oldest(count); i < count; ++i) {
+                origin = std::min(origin, buffer->events[i % EVENTS_PER_THREAD].start);
+            }
+        }
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        for (std::size_t tid = 0; tid < buffers.size(); ++tid) {
+            const Buffer& buffer = *buffers[tid];
+            file << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid + 1
+                << ",\"args\":{\"name\":\"" << (buffer.name ? buffer.name : "thread") << "\"}}";
+            first = false;
+
+            std::uint64_t count = buffer.count.load(std::memory_order_acquire);
+            for (std::uint64_t i = oldest(count); i < count; ++i) {
+                const Event& event = buffer.events[i % EVENTS_PER_THREAD];
+                file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid + 1
+                    << ",\"ts\":" << event.start - origin << ",\"dur\":" << event.duration << "}";
+            }
+            if (std::uint64_t overwritten = oldest(count)) {
+                std::cout << "trace: " << (buffer.name ? buffer.name : "a thread") << " wrapped, its "
+                    << overwritten << " oldest zones were overwritten" << std::endl;
+            }
+        }
+        file << "\n]}\n";
+        return static_cast<bool>(file);
+    }
+
+private:
+    struct Event {
+        const char* name;
+        sf::Int64 start;
+        sf::Int64 duration;
+    };
+
+    // count is every zone the thread recorded; the ring holds the newest
+    struct Buffer {
+        const char* name = nullptr;
+        std::atomic<std::uint64_t> count{ 0 };
+        std::array<Event, EVENTS_PER_THREAD> events;
+    };
+
+    static std::uint64_t oldest(std::uint64_t count) {
+        return count > EVENTS_PER_THREAD ? count - EVENTS_PER_THREAD : 0;
+    }
+
+    static std::atomic<bool>& flag() {
+        static std::atomic<bool> active{ false };
+        return active;
+    }
+
+    static const char*& threadName() {
+        static thread_local const char* name = nullptr;
+        return name;
+    }
+
+    static Buffer*& local() {
+        static thread_local Buffer* buffer = nullptr;
+        return buffer;
+    }
+
+    // Buffers live until exit, so a thread may finish before the export
+    static Buffer* attach() {
+        std::unique_ptr<Buffer> buffer(new Buffer());
+        buffer->name = threadName();
+        local() = buffer.get();
+        std::lock_guard<std::mutex> lock(registryMutex());
+        registry().push_back(std::move(buffer));
+        return local();
+    }
+
+    static std::mutex& registryMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::vector<std::unique_ptr<Buffer>>& registry() {
+        static std::vector<std::unique_ptr<Buffer>> buffers;
+        return buffers;
+    }
+};
+
+// Records the enclosing scope as a Tracer zone. The name must be a string
+// literal, it is kept by pointer until the trace is written. The flag is
+// checked once, in the constructor, which only keeps the name when tracing is
+// on; the destructor tests that name and nothing else, so toggling mid-zone
+// never records half a zone.
+class TraceZone {
+public:
+    explicit TraceZone(const char* name) {
+        if (Tracer::enabled()) {
+            this->name = name;
+            start = nowMicros();
+        }
+    }
+    ~TraceZone() {
+        if (name) Tracer::record(name, start, nowMicros());
+    }
+
+    TraceZone(const TraceZone&) = delete;
+    TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+    const char* name = nullptr;
+    sf::Int64 start = 0;
+};
+
+#ifndef SHAOLIN_NO_ALLOCATION_HOOKS
+void* operator new(std::size_t size) {
+    AllocationTracker::record(size);
+    if (void* block = std::malloc(size ? size : 1)) return block;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    AllocationTracker::record(size);
+    if (void* block = std::malloc(size ? size : 1)) return block;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* block) noexcept { std::free(block); }
+void operator delete[](void* block) noexcept { std::free(block); }
+void operator delete(void* block, std::size_t) noexcept { std::free(block); }
+void operator delete[](void* block, std::size_t) noexcept { std::free(block); }
+#endif
+
+// Each resource is loaded on first use and shared afterwards
+class ResourceManager {
+public:
+    static sf::Font& getFont() {
+        static sf::Font font;
+        static bool loaded = false;
+        if (!loaded) {
+            ScopedMetricTimer timer(Telemetry::get().assetLoad, FlightRecorder::ASSET, "videotype.otf");
+            if (!font.loadFromFile(RESOURCES_DIR + "videotype.otf")) {
+                throw std::runtime_error("Failed to load font!");
+            }
+            loaded = true;
+        }
+        return font;
+    }
+
+    // Mipmapped, as buttons draw it at many sizes, most of them smaller than the image
+    static sf::Texture& getButtonTexture() {
+        static sf::Texture texture;
+        static bool loaded = false;
+        if (!loaded) {
+            ScopedMetricTimer timer(Telemetry::get().assetLoad, FlightRecorder::ASSET, "knopka.png");
+            sf::Image image;
+            if (!image.loadFromFile(RESOURCES_DIR + "knopka.png")) {
+                throw std::runtime_error("Failed to load button texture!");
+            }
+            upload("button", texture, image, true);
+            loaded = true;
+        }
+        return texture;
+    }
+
+    static sf::SoundBuffer& getClickSound() {
+        static sf::SoundBuffer buffer;
+        static bool loaded = false;
+        if (!loaded) {
+            ScopedMetricTimer timer(Telemetry::get().assetLoad, FlightRecorder::ASSET, "mixkit-arcade-game-jump-coin-216.wav");
+            if (!buffer.loadFromFile(RESOURCES_DIR + "mixkit-arcade-game-jump-coin-216.wav")) {
+                throw std::runtime_error("Failed to load click sound!");
+            }
+            loaded = true;
+        }
+        return buffer;
+    }
+
+    static sf::SoundBuffer& getWinSound() {
+        static sf::SoundBuffer buffer;
+        static bool loaded = false;
+        if (!loaded) {
+            ScopedMetricTimer timer(Telemetry::get().assetLoad, FlightRecorder::ASSET, "9f2836f2b6a3690.mp3");
+            if (!buffer.loadFromFile(RESOURCES_DIR + "9f2836f2b6a3690.mp3")) {
+                throw std::runtime_error("Failed to load win sound!");
+            }
+            loaded = true;
+        }
+        return buffer;
+    }
+
+    static sf::SoundBuffer& getLoseSound() {
+        static sf::SoundBuffer buffer;
+        static bool loaded = false;
+        if (!loaded) {
+            ScopedMetricTimer timer(Telemetry::get().assetLoad, FlightRecorder::ASSET, "e285e54b799801b.mp3");
+            if (!buffer.loadFromFile(RESOURCES_DIR + "e285e54b799801b.mp3")) {
+                throw std::runtime_error("Failed to load lose sound!");
+            }
+            loaded = true;
+        }
+        return buffer;
+    }
+
+    // The background pre-scaled to the size it is drawn at, rebuilt when that
+    // size changes. A source smaller than the target is kept as is. Mipmaps
+    // serve the reduced-scale static layer of the lower quality levels.
+    static sf::Texture& getBackgroundTexture(sf::Vector2u targetSize) {
+        static sf::Texture texture;
+        static sf::Vector2u builtFor;
+        if (builtFor != targetSize) {
+            ScopedMetricTimer timer(Telemetry::get().assetLoad, FlightRecorder::ASSET, "background1.jpg");
+            sf::Image image;
+            if (!image.loadFromFile(RESOURCES_DIR + "background1.jpg")) {
+                throw std::runtime_error("Failed to load background texture!");
+            }
+            sf::Image scaled;
+            bool shrunk = downscale(image, targetSize, scaled);
+            upload("background", texture, shrunk ? scaled : image, true);
+            builtFor = targetSize;
+        }
+        return texture;
+    }
+
+    // Shop items use the button art, so they share its mipmapped texture
+    // instead of uploading knopka.png a second time without mipmaps
+    static sf::Texture& getShopItemTexture() {
+        return getButtonTexture();
+    }
+
+    static std::size_t textureCount() { return uploads().size(); }
+
+    // Video memory held by the textures built so far and the time their last upload took
+    static void reportTextures(std::ostream& out) {
+        std::size_t total = 0;
+        for (const TextureUpload& entry : uploads()) {
+            out << "texture " << entry.name << ": " << entry.size.x << "x" << entry.size.y
+                << (entry.mipmapped ? " mipmapped" : "") << ", " << std::fixed << std::setprecision(2)
+                << entry.bytes / (1024.0 * 1024.0) << " MB, upload " << entry.uploadMicros / 1000.0 << " ms" << std::endl;
+            total += entry.bytes;
+        }
+        out << "textures: " << std::fixed << std::setprecision(2) << total / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+
+private:
+    struct TextureUpload {
+        const char* name;
+        sf::Vector2u size;
+        bool mipmapped;
+        std::size_t bytes;
+        std::int64_t uploadMicros;
+    };
+
+    static std::vector<TextureUpload>& uploads() {
+        static std::vector<TextureUpload> entries;
+        return entries;
+    }
+
+    static void upload(const char* name, sf::Texture& texture, const sf::Image& image, bool mipmap) {
+        sf::Int64 start = nowMicros();
+        if (!texture.loadFromImage(image)) {
+            throw std::runtime_error(std::string("Failed to upload ") + name + " texture!");
+        }
+        texture.setSmooth(true);
+        bool mipmapped = mipmap && texture.generateMipmap();
+        sf::Int64 micros = nowMicros() - start;
+
+        // A full mip chain adds a third to the base level
+        sf::Vector2u size = image.getSize();
+        std::size_t bytes = static_cast<std::size_t>(size.x) * size.y * 4;
+        if (mipmapped) bytes += bytes / 3;
+
+        TextureUpload entry = { name, size, mipmapped, bytes, micros };
+        for (TextureUpload& existing : uploads()) {
+            if (std::strcmp(existing.name, name) == 0) {
+                existing = entry;
+                return;
+            }
+        }
+        uploads().push_back(entry);
+    }
+
+    // Box-filters source down to at most targetSize on each axis; false when
+    // the source already fits
+    static bool downscale(const sf::Image& source, sf::Vector2u targetSize, sf::Image& result) {
+        sf::Vector2u from = source.getSize();
+        sf::Vector2u to(std::max(1u, std::min(from.x, targetSize.x)), std::max(1u, std::min(from.y, targetSize.y)));
+        if (to == from) return false;
+
+        std::vector<sf::Uint8> pixels(static_cast<std::size_t>(to.x) * to.y * 4);
+        const sf::Uint8* in = source.getPixelsPtr();
+        for (unsigned y = 0; y < to.y; ++y) {
+            unsigned y0 = y * from.y / to.y;
+            unsigned y1 = std::max(y0 + 1, (y + 1) * from.y / to.y);
+            for (unsigned x = 0; x < to.x; ++x) {
+                unsigned x0 = x * from.x / to.x;
+                unsigned x1 = std::max(x0 + 1, (x + 1) * from.x / to.x);
+                unsigned sum[4] = { 0, 0, 0, 0 };
+                for (unsigned sy = y0; sy < y1; ++sy) {
+                    const sf::Uint8* row = in + (static_cast<std::size_t>(sy) * from.x + x0) * 4;
+                    for (unsigned sx = x0; sx < x1; ++sx, row += 4) {
+                        sum[0] += row[0];
+                        sum[1] += row[1];
+                        sum[2] += row[2];
+                        sum[3] += row[3];
+                    }
+                }
+                unsigned count = (y1 - y0) * (x1 - x0);
+                sf::Uint8* out = &pixels[(static_cast<std::size_t>(y) * to.x + x) * 4];
+                for (int c = 0; c < 4; ++c) out[c] = static_cast<sf::Uint8>((sum[c] + count / 2) / count);
+            }
+        }
+        result.create(to.x, to.y, pixels.data());
+        return true;
+    }
+};
+
+enum class Ease { Linear, OutQuad, OutCubic, InOutSine };
+
+inline float applyEase(Ease ease, float t) {
+    switch (ease) {
+    case Ease::OutQuad: return 1.f - (1.f - t) * (1.f - t);
+    case Ease::OutCubic: return 1.f - (1.f - t) * (1.f - t) * (1.f - t);
+    case Ease::InOutSine: return 0.5f - 0.5f * std::cos(t * 3.14159265f);
+    case Ease::Linear:
+    default: return t;
+    }
+}
+
+// Owns every animated scalar in the game. Tracks live in one contiguous
+// vector and are advanced together once per frame; callers keep an index.
+class TweenScheduler {
+public:
+    typedef int TweenId;
+    static const TweenId INVALID = -1;
+
+    enum Mode { ONCE, PING_PONG, LOOP };
+
+    static TweenScheduler& instance() {
+        static TweenScheduler scheduler;
+        return scheduler;
+    }
+
+    TweenId create(float initialValue) {
+        TweenId id;
+        if (!freeList.empty()) {
+            id = freeList.back();
+            freeList.pop_back();
+        }
+        else {
+            id = static_cast<TweenId>(tracks.size());
+            tracks.emplace_back();
+        }
+        Track& track = tracks[id];
+        track = Track();
+        track.inUse = true;
+        track.value = track.from = track.to = initialValue;
+        return id;
+    }
+
+    void release(TweenId id) {
+        if (!valid(id)) return;
+        tracks[id].inUse = false;
+        tracks[id].active = false;
+        freeList.push_back(id);
+    }
+
+    // Retargets from the current value, so interrupted tweens do not jump
+    void animateTo(TweenId id, float target, float duration, Ease ease = Ease::OutCubic, float delay = 0.f) {
+        if (!valid(id)) return;
+        Track& track = tracks[id];
+        if (track.active && track.mode == ONCE && track.to == target) return;
+        start(track, track.value, target, duration, ease, ONCE, delay);
+    }
+
+    void play(TweenId id, float from, float to, float duration, Ease ease, Mode mode) {
+        if (!valid(id)) return;
+        start(tracks[id], from, to, duration, ease, mode, 0.f);
+    }
+
+    void set(TweenId id, float value) {
+        if (!valid(id)) return;
+        Track& track = tracks[id];
+        track.value = track.from = track.to = value;
+        track.active = false;
+    }
+
+    void setPaused(TweenId id, bool paused) {
+        if (valid(id)) tracks[id].paused = paused;
+    }
+
+    float value(TweenId id) const { return valid(id) ? tracks[id].value : 0.f; }
+
+    bool isMoving(TweenId id) const {
+        return valid(id) && tracks[id].active && !tracks[id].paused;
+    }
+
+    // True when no track will change value on the next update
+    bool isSettled() const { return movingCount == 0; }
+
+    void update(float dt) {
+        int moving = 0;
+        for (auto& track : tracks) {
+            if (!track.active || track.paused) continue;
+
+            if (track.delay > 0.f) {
+                track.delay -= dt;
+                ++moving;
+                if (track.delay > 0.f) continue;
+                track.elapsed = -track.delay;
+                track.delay = 0.f;
+            }
+            else {
+                track.elapsed += dt;
+            }
+
+            if (track.elapsed >= track.duration) {
+                if (track.mode == ONCE) {
+                    track.value = track.to;
+                    track.active = false;
+                    continue;
+                }
+                track.elapsed = std::fmod(track.elapsed, track.duration);
+                if (track.mode == PING_PONG) std::swap(track.from, track.to);
+            }
+
+            float t = track.duration > 0.f ? track.elapsed / track.duration : 1.f;
+            track.value = track.from + (track.to - track.from) * applyEase(track.ease, t);
+            ++moving;
+        }
+        movingCount = moving;
+    }
+
+private:
+    struct Track {
+        float from = 0.f;
+        float to = 0.f;
+        float value = 0.f;
+        float elapsed = 0.f;
+        float duration = 0.f;
+        float delay = 0.f;
+        Ease ease = Ease::Linear;
+        Mode mode = ONCE;
+        bool active = false;
+        bool paused = false;
+        bool inUse = false;
+    };
+
+    std::vector<Track> tracks;
+    std::vector<TweenId> freeList;
+    int movingCount = 0;
+
+    bool valid(TweenId id) const {
+        return id >= 0 && id < static_cast<TweenId>(tracks.size()) && tracks[id].inUse;
+    }
+
+    void start(Track& track, float from, float to, float duration, Ease ease, Mode mode, float delay) {
+        track.from = from;
+        track.to = to;
+        track.value = from;
+        track.elapsed = 0.f;
+        track.duration = duration;
+        track.delay = delay;
+        track.ease = ease;
+        track.mode = mode;
+        track.active = true;
+        ++movingCount;
+    }
+};
+
+// Game time only moves when advanced by the update pass, so it can be
+// paused, single-stepped or driven by a replay instead of the wall clock
+class GameClock {
+public:
+    void advance(sf::Time delta) {
+        if (!paused) current += delta;
+    }
+    sf::Time now() const { return current; }
+    void setPaused(bool isPaused) { paused = isPaused; }
+    bool isPaused() const { return paused; }
+
+private:
+    sf::Time current;
+    bool paused = false;
+};
+
+// Min-heap of game-time deadlines. Each entry fires exactly once, in
+// deadline order; repeating timers reschedule themselves from the handler.
+class DeadlineScheduler {
+public:
+    typedef std::uint32_t TimerId;
+    static const TimerId INVALID = 0;
+
+    TimerId schedule(sf::Time at, int event) {
+        Entry entry;
+        entry.at = at;
+        entry.id = ++lastId;
+        entry.event = event;
+        heap.push_back(entry);
+        std::push_heap(heap.begin(), heap.end(), Later());
+        return entry.id;
+    }
+
+    void cancel(TimerId id) {
+        if (id == INVALID) return;
+        auto it = std::find_if(heap.begin(), heap.end(), [id](const Entry& e) { return e.id == id; });
+        if (it == heap.end()) return;
+        heap.erase(it);
+        std::make_heap(heap.begin(), heap.end(), Later());
+    }
+
+    void cancelEvent(int event) {
+        auto it = std::remove_if(heap.begin(), heap.end(), [event](const Entry& e) { return e.event == event; });
+        if (it == heap.end()) return;
+        heap.erase(it, heap.end());
+        std::make_heap(heap.begin(), heap.end(), Later());
+    }
+
+    // Pops every deadline at or before now and hands its event to the handler
+    template <typename Handler>
+    int fireDue(sf::Time now, Handler&& handler) {
+        int fired = 0;
+        while (!heap.empty() && heap.front().at <= now) {
+            std::pop_heap(heap.begin(), heap.end(), Later());
+            Entry entry = heap.back();
+            heap.pop_back();
+            handler(entry.event);
+            ++fired;
+        }
+        return fired;
+    }
+
+    bool empty() const { return heap.empty(); }
+
+    // Game time left until the earliest deadline, or the fallback when there is none
+    sf::Time timeUntilNext(sf::Time now, sf::Time fallback) const {
+        if (heap.empty()) return fallback;
+        sf::Time left = heap.front().at - now;
+        return left > sf::Time::Zero ? left : sf::Time::Zero;
+    }
+
+private:
+    struct Entry {
+        sf::Time at;
+        TimerId id;
+        int event;
+    };
+    struct Later {
+        bool operator()(const Entry& a, const Entry& b) const {
+            return a.at > b.at || (a.at == b.at && a.id > b.id);
+        }
+    };
+
+    std::vector<Entry> heap;
+    TimerId lastId = INVALID;
+};
+
+// Screen layout described once in design units (the 800x600 base resolution)
+// and resolved to window pixels only when the window size changes. A box has
+// a fixed design size; a stack lines its children up in a row or a column
+// with spacing between them; a placed node is pinned to a point of the window.
+// Nodes are created children first, so one pass in each direction resolves
+// every size and then every position.
+class UiLayout {
+public:
+    typedef int Node;
+    enum Direction { ROW, COLUMN };
+    enum Align { START, CENTER };   // of children across the stack direction
+
+    Node box(float width, float height) {
+        nodes.emplace_back();
+        nodes.back().size = sf::Vector2f(width, height);
+        invalidate();
+        return static_cast<Node>(nodes.size() - 1);
+    }
+
+    Node stack(Direction direction, const Node* children, std::size_t count, float spacing, Align align = START) {
+        Item item;
+        item.stack = true;
+        item.direction = direction;
+        item.align = align;
+        item.spacing = spacing;
+        item.firstChild = childList.size();
+        item.childCount = count;
+        childList.insert(childList.end(), children, children + count);
+        nodes.push_back(item);
+        invalidate();
+        return static_cast<Node>(nodes.size() - 1);
+    }
+
+    Node stack(Direction direction, std::initializer_list<Node> children, float spacing, Align align = START) {
+        return stack(direction, children.begin(), children.size(), spacing, align);
+    }
+
+    // Puts the pivot of the node (fractions of its own size) on the anchor
+    // (fractions of the window), moved by offset design units
+    void place(Node node, sf::Vector2f anchor, sf::Vector2f pivot, sf::Vector2f offset = sf::Vector2f()) {
+        Item& item = nodes[node];
+        item.placed = true;
+        item.anchor = anchor;
+        item.pivot = pivot;
+        item.offset = offset;
+        invalidate();
+    }
+
+    // A placed point, for text aligned by its own measured width
+    Node pin(sf::Vector2f anchor, sf::Vector2f offset) {
+        Node node = box(0.f, 0.f);
+        place(node, anchor, sf::Vector2f(), offset);
+        return node;
+    }
+
+    // Marks the layout stale after its content changed
+    void invalidate() { ++version; }
+
+    // Returns false when nothing changed since the last call
+    bool resolve(sf::Vector2u windowSize) {
+        if (windowSize == resolvedSize && version == resolvedVersion) return false;
+        resolvedSize = windowSize;
+        resolvedVersion = version;
+        uiScale = std::min(windowSize.x / 800.f, windowSize.y / 600.f);
+
+        for (Item& item : nodes) {
+            if (!item.stack) continue;
+            sf::Vector2f size;
+            for (std::size_t i = 0; i < item.childCount; ++i) {
+                const sf::Vector2f& child = nodes[childList[item.firstChild + i]].size;
+                float along = item.direction == ROW ? child.x : child.y;
+                float across = item.direction == ROW ? child.y : child.x;
+                (item.direction == ROW ? size.x : size.y) += along + (i > 0 ? item.spacing : 0.f);
+                float& extent = item.direction == ROW ? size.y : size.x;
+                extent = std::max(extent, across);
+            }
+            item.size = size;
+        }
+
+        for (std::size_t n = nodes.size(); n-- > 0;) {
+            Item& item = nodes[n];
+            sf::Vector2f size = item.size * uiScale;
+            if (item.placed) {
+                item.rect = sf::FloatRect(
+                    windowSize.x * item.anchor.x - size.x * item.pivot.x + item.offset.x * uiScale,
+                    windowSize.y * item.anchor.y - size.y * item.pivot.y + item.offset.y * uiScale,
+                    size.x, size.y);
+            }
+            if (!item.stack) continue;
+
+            float cursor = item.direction == ROW ? item.rect.left : item.rect.top;
+            for (std::size_t i = 0; i < item.childCount; ++i) {
+                Item& child = nodes[childList[item.firstChild + i]];
+                sf::Vector2f childSize = child.size * uiScale;
+                float slack = item.align == CENTER ? 0.5f : 0.f;
+                if (item.direction == ROW) {
+                    child.rect = sf::FloatRect(cursor, item.rect.top + (size.y - childSize.y) * slack, childSize.x, childSize.y);
+                    cursor += childSize.x + item.spacing * uiScale;
+                }
+                else {
+                    child.rect = sf::FloatRect(item.rect.left + (size.x - childSize.x) * slack, cursor, childSize.x, childSize.y);
+                    cursor += childSize.y + item.spacing * uiScale;
+                }
+            }
+        }
+        return true;
+    }
+
+    const sf::FloatRect& rect(Node node) const { return nodes[node].rect; }
+    sf::Vector2f point(Node node) const { return sf::Vector2f(nodes[node].rect.left, nodes[node].rect.top); }
+
+    // Window size over the base resolution, the same on both axes
+    float scale() const { return uiScale; }
+
+private:
+    struct Item {
+        bool stack = false;
+        bool placed = false;
+        Direction direction = ROW;
+        Align align = START;
+        float spacing = 0.f;
+        std::size_t firstChild = 0;
+        std::size_t childCount = 0;
+        sf::Vector2f anchor;
+        sf::Vector2f pivot;
+        sf::Vector2f offset;
+        sf::Vector2f size;      // design units
+        sf::FloatRect rect;     // window pixels
+    };
+
+    std::vector<Item> nodes;
+    std::vector<Node> childList;
+    unsigned version = 0;
+    unsigned resolvedVersion = 0;
+    sf::Vector2u resolvedSize;
+    float uiScale = 1.f;
+};
+
+// Label whose glyphs are only rebuilt when its content changes. Content is
+// formatted into a fixed buffer and copied into a reused sf::String, so an
+// unchanged label redraws without touching the heap.
+class CachedText {
+public:
+    CachedText() { content[0] = '\0'; }
+
+    void setStyle(unsigned int characterSize, const sf::Color& color) {
+        if (!text.getFont()) text.setFont(ResourceManager::getFont());
+        if (text.getCharacterSize() != characterSize) {
+            text.setCharacterSize(characterSize);
+            moved = true;
+        }
+        text.setFillColor(color);
+    }
+
+    // Keeps the left edge, centre or right edge of the text (pivot 0, 0.5 or
+    // 1) at point. It is measured again only when the string or size changes.
+    void setAnchor(sf::Vector2f point, float pivot) {
+        anchor = point;
+        anchorPivot = pivot;
+        moved = true;
+    }
+
+    void format(const char* pattern, ...) {
+        char next[CAPACITY];
+        va_list args;
+        va_start(args, pattern);
+        std::vsnprintf(next, CAPACITY, pattern, args);
+        va_end(args);
+        if (std::strcmp(next, content) == 0) return;
+
+        std::memcpy(content, next, CAPACITY);
+        // Single code points fit the small-string buffer, so this reuses scratch's storage
+        scratch.clear();
+        for (const char* c = content; *c; ++c) {
+            scratch += sf::String(static_cast<sf::Uint32>(static_cast<unsigned char>(*c)));
+        }
+        text.setString(scratch);
+        moved = true;
+    }
+
+    sf::Text& get() {
+        if (moved) {
+            text.setPosition(anchor.x - text.getLocalBounds().width * anchorPivot, anchor.y);
+            moved = false;
+        }
+        return text;
+    }
+
+private:
+    static const std::size_t CAPACITY = 128;
+
+    sf::Text text;
+    sf::String scratch;
+    char content[CAPACITY];
+    sf::Vector2f anchor;
+    float anchorPivot = 0.f;
+    bool moved = false;
+};
+
+// What a button asks the game to do. Buttons only enqueue these; the game runs
+// them once the update pass has finished walking every button list.
+struct UiCommand {
+    enum Type {
+        NONE,
+        START_GAME,
+        SHOW_SCREEN,        // value: GameState
+        SELECT_DIFFICULTY,  // value: Difficulty
+        OPEN_ANALYSIS,
+        CLOSE_ANALYSIS,
+        SET_RESOLUTION,     // value: width, extra: height
+        SET_FULLSCREEN,
+        RESET_PROGRESS,
+        PURCHASE_ITEM,      // value: shop item index
+        NEXT_PROFILE,
+        QUIT
+    };
+
+    UiCommand(Type type = NONE, int value = 0, int extra = 0)
+        : type(type), value(value), extra(extra) {
+    }
+
+    static const char* name(Type type) {
+        static const char* names[] = { "none", "start game", "show screen", "select difficulty", "open analysis",
+            "close analysis", "set resolution", "set fullscreen", "reset progress", "purchase item", "next profile", "quit" };
+        return names[type];
+    }
+
+    Type type;
+    int value;
+    int extra;
+    sf::Int64 stamp = 0;    // when the input that issued it was received, 0 if none
+};
+
+// A left-button press as delivered by the OS event, in window pixels, and
+// mapped through the window's view when it was received
+struct PointerPress {
+    sf::Vector2i position;
+    sf::Vector2f point;
+    sf::Int64 stamp = 0;
+};
+
+// What the game logic may know of the window. It is captured with every
+// event by the thread that owns the window, so in threaded mode the logic
+// thread never touches the window itself.
+struct WindowInput {
+    sf::Vector2i pointer;       // window pixels
+    sf::Vector2u size;
+    sf::View view;
+
+    // RenderTarget::mapPixelToCoords, for a window of this size and view
+    sf::Vector2f mapPixelToCoords(sf::Vector2i pixel) const {
+        const sf::FloatRect& ratio = view.getViewport();
+        sf::FloatRect viewport(size.x * ratio.left, size.y * ratio.top, size.x * ratio.width, size.y * ratio.height);
+        sf::Vector2f normalized(-1.f + 2.f * (pixel.x - viewport.left) / viewport.width,
+            1.f - 2.f * (pixel.y - viewport.top) / viewport.height);
+        return view.getInverseTransform().transformPoint(normalized);
+    }
+};
+
+// Fixed-capacity single-threaded FIFO, used for input and commands that
+// are produced and consumed within the update pass
+template <typename T, std::size_t CAPACITY>
+class BoundedQueue {
+public:
+    bool push(const T& item) {
+        if (count == CAPACITY) return false;
+        items[(head + count) % CAPACITY] = item;
+        ++count;
+        return true;
+    }
+
+    bool pop(T& item) {
+        if (count == 0) return false;
+        item = items[head];
+        head = (head + 1) % CAPACITY;
+        --count;
+        return true;
+    }
+
+    bool empty() const { return count == 0; }
+    void clear() { head = count = 0; }
+
+private:
+    std::array<T, CAPACITY> items;
+    std::size_t head = 0;
+    std::size_t count = 0;
+};
+
+typedef BoundedQueue<UiCommand, 32> CommandQueue;
+typedef BoundedQueue<PointerPress, 16> PressQueue;
+
+// Per-frame look of a button, published by the update pass and applied at
+// draw time. It also carries what drawing needs of the button's flags, so
+// the draw thread never reads them while the update pass writes them.
+struct ButtonVisual {
+    float offsetY = 0.f;
+    int zIndex = 0;
+    bool hovered = false;
+    bool visible = false;      // false too for a released widget
+    bool hoverEffect = true;
+};
+
+// Every button of every screen in one fixed-capacity pool, stored as
+// structure-of-arrays like the particle pool: what the update pass reads
+// each frame (resting bounds, flags, hover tween) sits in contiguous arrays,
+// while the command and the drawables, touched only on a press or at draw
+// time, live apart. Widgets are named by handles carrying a generation, so a
+// handle kept past its widget's release is recognised as stale instead of
+// reaching whichever widget took the slot over. Released slots are reused,
+// and the arrays never grow after construction, so rebuilding a screen
+// allocates no widget storage and the draw thread can keep reading the
+// slots of the screen it is drawing while another screen is built.
+class WidgetPool {
+public:
+    static const std::size_t DEFAULT_CAPACITY = 256;
+
+    struct Handle {
+        std::uint32_t index = 0xFFFFFFFFu;
+        std::uint32_t generation = 0;
+    };
+
+    explicit WidgetPool(std::size_t capacity = DEFAULT_CAPACITY)
+        : bounds(capacity), hoverTween(capacity, TweenScheduler::INVALID), flags(capacity, 0),
+        generations(capacity, 0), cold(capacity) {
+        freeSlots.reserve(capacity);
+        for (std::size_t i = capacity; i > 0; --i) freeSlots.push_back(static_cast<std::uint32_t>(i - 1));
+    }
+
+    WidgetPool(const WidgetPool&) = delete;
+    WidgetPool& operator=(const WidgetPool&) = delete;
+
+    ~WidgetPool() {
+        for (std::size_t i = 0; i < flags.size(); ++i) {
+            if (flags[i] & IN_USE) TweenScheduler::instance().release(hoverTween[i]);
+        }
+    }
+
+    Handle create(const std::string& text, sf::FloatRect rect, UiCommand command, int zIndex = 0, int fontSize = 24) {
+        if (freeSlots.empty()) {
+            throw std::runtime_error("Widget pool is full!");
+        }
+        std::uint32_t i = freeSlots.back();
+        freeSlots.pop_back();
+
+        bounds[i] = rect;
+        hoverTween[i] = TweenScheduler::instance().create(0.f);
+        flags[i] = IN_USE | VISIBLE | HOVER_EFFECT | HOVER_ANIMATED;
+
+        Cold& data = cold[i];
+        data.rest = rect;
+        data.command = command;
+        data.zIndex = zIndex;
+        data.fontSize = fontSize;
+        data.shape.setSize({ rect.width, rect.height });
+        data.shape.setPosition(rect.left, rect.top);
+        data.shape.setTexture(&ResourceManager::getButtonTexture());
+        data.shape.setOutlineThickness(2.f);
+        data.shape.setOutlineColor(sf::Color::Transparent);
+        data.label.setFont(ResourceManager::getFont());
+        data.label.setString(text);
+        data.label.setCharacterSize(fontSize);
+        data.label.setFillColor(sf::Color::White);
+
+        Handle handle;
+        handle.index = i;
+        handle.generation = generations[i];
+        return handle;
+    }
+
+    void release(Handle handle) {
+        if (!alive(handle)) return;
+        TweenScheduler::instance().release(hoverTween[handle.index]);
+        hoverTween[handle.index] = TweenScheduler::INVALID;
+        flags[handle.index] = 0;
+        ++generations[handle.index];
+        freeSlots.push_back(handle.index);
+    }
+
+    bool alive(Handle handle) const {
+        return handle.index < flags.size() && (flags[handle.index] & IN_USE) && generations[handle.index] == handle.generation;
+    }
+
+    std::size_t size() const { return flags.size() - freeSlots.size(); }
+    std::size_t capacity() const { return flags.size(); }
+
+    // Storage each slot takes, hot and cold together
+    static std::size_t bytesPerWidget() {
+        return sizeof(sf::FloatRect) + sizeof(TweenScheduler::TweenId) + sizeof(std::uint8_t) + sizeof(std::uint32_t) + sizeof(Cold);
+    }
+
+    void setVisible(Handle handle, bool visible) {
+        if (!alive(handle)) return;
+        std::uint8_t& f = flags[handle.index];
+        f = visible ? f | VISIBLE : f & ~(VISIBLE | HOVERED);
+    }
+    void setHoverAnimated(Handle handle, bool animated) { setFlag(handle, HOVER_ANIMATED, animated); }
+    void setHoverEffect(Handle handle, bool active) { setFlag(handle, HOVER_EFFECT, active); }
+
+    // One pass over a screen's widgets. Clicks are edge-triggered: press is
+    // the pending OS press event, or nullptr if there is none this frame or
+    // another screen has already taken it; only the first widget under it
+    // issues its command. Returns true when one did. Never touches the
+    // drawables, so it can run on a different thread than draw().
+    bool update(const Handle* widgets, std::size_t count, sf::Vector2i mouse, const PointerPress* press,
+        bool allowInteraction, CommandQueue& commands) {
+        TweenScheduler& tweens = TweenScheduler::instance();
+        bool pressed = false;
+        for (std::size_t n = 0; n < count; ++n) {
+            std::uint32_t i = widgets[n].index;
+            std::uint8_t f = flags[i] & ~HOVERED;
+            if (!(f & VISIBLE) || !allowInteraction) {
+                flags[i] = f;
+                continue;
+            }
+
+            sf::FloatRect hit = bounds[i];
+            if (f & HOVER_EFFECT) hit.top += tweens.value(hoverTween[i]);
+            if (hit.contains(static_cast<float>(mouse.x), static_cast<float>(mouse.y))) f |= HOVERED;
+            flags[i] = f;
+
+            if (f & HOVER_EFFECT) {
+                float target = (f & HOVERED) ? -10.f : 0.f;
+                if (f & HOVER_ANIMATED) tweens.animateTo(hoverTween[i], target, 0.2f, Ease::OutCubic);
+                else tweens.set(hoverTween[i], target);
+            }
+
+            if (press && !pressed && hit.contains(static_cast<float>(press->position.x), static_cast<float>(press->position.y))) {
+                pressed = true;
+                UiCommand issued = cold[i].command;
+                issued.stamp = press->stamp;
+                commands.push(issued);
+            }
+        }
+        return pressed;
+    }
+
+    ButtonVisual visual(Handle handle) const {
+        ButtonVisual visual;
+        if (!alive(handle)) return visual;
+        std::uint8_t f = flags[handle.index];
+        visual.offsetY = (f & HOVER_EFFECT) ? TweenScheduler::instance().value(hoverTween[handle.index]) : 0.f;
+        visual.hovered = (f & HOVERED) != 0;
+        visual.visible = (f & VISIBLE) != 0;
+        visual.hoverEffect = (f & HOVER_EFFECT) != 0;
+        visual.zIndex = cold[handle.index].zIndex;
+        return visual;
+    }
+
+    // Reads only the cold data and the published visual. The handle is not
+    // checked: a screen's widgets are released only after the last snapshot
+    // showing it has been drawn, and a dead widget publishes as invisible.
+    void draw(sf::RenderTarget& target, Handle handle, const ButtonVisual& visual) {
+        if (!visual.visible) return;
+        Cold& data = cold[handle.index];
+        const sf::FloatRect& rest = data.rest;
+
+        data.shape.setPosition(rest.left, rest.top + visual.offsetY);
+        if (visual.hoverEffect) {
+            data.shape.setFillColor(visual.hovered ?
+                sf::Color(255, 255, 255, 180) :
+                sf::Color(255, 255, 255, 140));
+
+            data.shape.setOutlineColor(visual.hovered ?
+                sf::Color(255, 215, 0, 255) :
+                sf::Color::Transparent);
+        }
+        data.label.setPosition(
+            rest.left + (rest.width - data.label.getLocalBounds().width) / 2.f,
+            rest.top + visual.offsetY + (rest.height - data.fontSize) / 2.f - 5.f
+        );
+
+        target.draw(data.shape);
+        target.draw(data.label);
+    }
+
+private:
+    enum Flag : std::uint8_t {
+        IN_USE = 1 << 0,
+        VISIBLE = 1 << 1,
+        HOVERED = 1 << 2,
+        HOVER_EFFECT = 1 << 3,
+        HOVER_ANIMATED = 1 << 4
+    };
+
+    struct Cold {
+        sf::FloatRect rest;         // bounds as created, for the draw thread
+        sf::RectangleShape shape;
+        sf::Text label;
+        UiCommand command;
+        int zIndex = 0;
+        int fontSize = 24;
+    };
+
+    void setFlag(Handle handle, std::uint8_t flag, bool on) {
+        if (!alive(handle)) return;
+        if (on) flags[handle.index] |= flag;
+        else flags[handle.index] &= ~flag;
+    }
+
+    // Hot, indexed by slot
+    std::vector<sf::FloatRect> bounds;      // at rest, before the hover offset
+    std::vector<TweenScheduler::TweenId> hoverTween;
+    std::vector<std::uint8_t> flags;
+    std::vector<std::uint32_t> generations;
+
+    // Cold, indexed by slot
+    std::vector<Cold> cold;
+
+    std::vector<std::uint32_t> freeSlots;
+};
+
+// The handles of one screen's widgets, released back to the pool with it
+class WidgetSet {
+public:
+    explicit WidgetSet(WidgetPool& pool) : pool(pool) {}
+    ~WidgetSet() {
+        for (WidgetPool::Handle handle : handles) pool.release(handle);
+    }
+
+    WidgetSet(const WidgetSet&) = delete;
+    WidgetSet& operator=(const WidgetSet&) = delete;
+
+    void push_back(WidgetPool::Handle handle) { handles.push_back(handle); }
+    WidgetPool::Handle back() const { return handles.back(); }
+    WidgetPool::Handle operator[](std::size_t i) const { return handles[i]; }
+    const WidgetPool::Handle* data() const { return handles.data(); }
+    std::size_t size() const { return handles.size(); }
+    std::vector<WidgetPool::Handle>::const_iterator begin() const { return handles.begin(); }
+    std::vector<WidgetPool::Handle>::const_iterator end() const { return handles.end(); }
+
+private:
+    WidgetPool& pool;
+    std::vector<WidgetPool::Handle> handles;
+};
+
+// Fixed-capacity particle pool stored as structure-of-arrays so the update
+// pass streams through contiguous floats. Dead particles are swap-removed,
+// keeping [0, aliveCount) packed for both the update and the vertex build.
+class ParticleSystem {
+public:
+    static constexpr std::size_t DEFAULT_CAPACITY = 32768;
+
+    explicit ParticleSystem(std::size_t capacity = DEFAULT_CAPACITY)
+        : capacity(capacity), rng(std::random_device{}()) {
+        // Pad to a multiple of 4 so the SIMD kernel never needs a scalar tail
+        std::size_t padded = (capacity + 3) & ~static_cast<std::size_t>(3);
+        posX.assign(padded, 0.f);
+        posY.assign(padded, 0.f);
+        velX.assign(padded, 0.f);
+        velY.assign(padded, 0.f);
+        accX.assign(padded, 0.f);
+        accY.assign(padded, 0.f);
+        life.assign(padded, 0.f);
+        invMaxLife.assign(padded, 0.f);
+        size.assign(padded, 0.f);
+        color.assign(padded, sf::Color::Transparent);
+        vertices.setPrimitiveType(sf::Quads);
+        vertices.resize(capacity * 4);
+    }
+
+    std::size_t getAliveCount() const { return aliveCount; }
+    std::size_t getCapacity() const { return capacity; }
+    void clear() { aliveCount = 0; }
+
+    // Confetti burst falling from the top edge
+    void emitConfetti(sf::Vector2u area, std::size_t count) {
+        static const sf::Color palette[] = {
+            sf::Color(255, 80, 80), sf::Color(80, 200, 255), sf::Color(255, 215, 0),
+            sf::Color(120, 255, 120), sf::Color(255, 120, 255)
+        };
+        std::uniform_real_distribution<float> xDist(0.f, static_cast<float>(area.x));
+        std::uniform_real_distribution<float> vxDist(-120.f, 120.f);
+        std::uniform_real_distribution<float> vyDist(-60.f, 240.f);
+        std::uniform_real_distribution<float> lifeDist(2.0f, 4.0f);
+        std::uniform_real_distribution<float> sizeDist(3.f, 7.f);
+        std::uniform_int_distribution<int> colorDist(0, 4);
+
+        for (std::size_t i = 0; i < count; ++i) {
+            spawn(xDist(rng), -10.f, vxDist(rng), vyDist(rng), 0.f, 300.f,
+                lifeDist(rng), sizeDist(rng), palette[colorDist(rng)]);
+        }
+    }
+
+    // Embers rising from a rectangle (the input box on "BOILING HOT!")
+    void emitEmbers(sf::FloatRect source, std::size_t count) {
+        std::uniform_real_distribution<float> xDist(source.left, source.left + source.width);
+        std::uniform_real_distribution<float> yDist(source.top, source.top + source.height);
+        std::uniform_real_distribution<float> vxDist(-30.f, 30.f);
+        std::uniform_real_distribution<float> vyDist(-140.f, -60.f);
+        std::uniform_real_distribution<float> lifeDist(0.6f, 1.4f);
+        std::uniform_real_distribution<float> sizeDist(2.f, 4.f);
+        std::uniform_int_distribution<int> greenDist(40, 160);
+
+        for (std::size_t i = 0; i < count; ++i) {
+            spawn(xDist(rng), yDist(rng), vxDist(rng), vyDist(rng), 0.f, -40.f,
+                lifeDist(rng), sizeDist(rng), sf::Color(255, static_cast<sf::Uint8>(greenDist(rng)), 0));
+        }
+    }
+
+    // Radial spark burst around a point (achievement toast)
+    void emitSparks(sf::Vector2f center, std::size_t count) {
+        std::uniform_real_distribution<float> angleDist(0.f, 6.2831853f);
+        std::uniform_real_distribution<float> speedDist(80.f, 320.f);
+        std::uniform_real_distribution<float> lifeDist(0.4f, 0.9f);
+        std::uniform_real_distribution<float> sizeDist(1.5f, 3.f);
+
+        for (std::size_t i = 0; i < count; ++i) {
+            float angle = angleDist(rng);
+            float speed = speedDist(rng);
+            spawn(center.x, center.y, std::cos(angle) * speed, std::sin(angle) * speed, 0.f, 200.f,
+                lifeDist(rng), sizeDist(rng), sf::Color(255, 230, 120));
+        }
+    }
+
+    void update(float dt) {
+#ifdef SHAOLIN_HAS_SSE2
+        integrateSimd(dt);
+#else
+        integrateScalar(dt);
+#endif
+        compact();
+    }
+
+    // Straightforward per-particle loop, kept as the reference for the benchmark
+    void integrateScalar(float dt) {
+        for (std::size_t i = 0; i < aliveCount; ++i) {
+            velX[i] += accX[i] * dt;
+            velY[i] += accY[i] * dt;
+            posX[i] += velX[i] * dt;
+            posY[i] += velY[i] * dt;
+            life[i] -= dt;
+        }
+    }
+
+    void integrateSimd(float dt) {
+#ifdef SHAOLIN_HAS_SSE2
+        const __m128 vdt = _mm_set1_ps(dt);
+        const std::size_t n = (aliveCount + 3) & ~static_cast<std::size_t>(3);
+        float* px = posX.data();
+        float* py = posY.data();
+        float* vx = velX.data();
+        float* vy = velY.data();
+        const float* ax = accX.data();
+        const float* ay = accY.data();
+        float* lf = life.data();
+
+        for (std::size_t i = 0; i < n; i += 4) {
+            __m128 nvx = _mm_add_ps(_mm_loadu_ps(vx + i), _mm_mul_ps(_mm_loadu_ps(ax + i), vdt));
+            __m128 nvy = _mm_add_ps(_mm_loadu_ps(vy + i), _mm_mul_ps(_mm_loadu_ps(ay + i), vdt));
+            _mm_storeu_ps(vx + i, nvx);
+            _mm_storeu_ps(vy + i, nvy);
+            _mm_storeu_ps(px + i, _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(nvx, vdt)));
+            _mm_storeu_ps(py + i, _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(nvy, vdt)));
+            _mm_storeu_ps(lf + i, _mm_sub_ps(_mm_loadu_ps(lf + i), vdt));
+        }
+#else
+        integrateScalar(dt);
+#endif
+    }
+
+    // Builds one quad per live particle and submits them in a single draw call
+    void draw(sf::RenderTarget& target) {
+        if (aliveCount == 0) return;
+
+        for (std::size_t i = 0; i < aliveCount; ++i) {
+            float half = size[i] * 0.5f;
+            float x0 = posX[i] - half, x1 = posX[i] + half;
+            float y0 = posY[i] - half, y1 = posY[i] + half;
+
+            sf::Color c = color[i];
+            float fade = life[i] * invMaxLife[i];
+            c.a = static_cast<sf::Uint8>(255.f * std::min(1.f, std::max(0.f, fade)));
+
+            sf::Vertex* quad = &vertices[i * 4];
+            quad[0].position = sf::Vector2f(x0, y0);
+            quad[1].position = sf::Vector2f(x1, y0);
+            quad[2].position = sf::Vector2f(x1, y1);
+            quad[3].position = sf::Vector2f(x0, y1);
+            quad[0].color = quad[1].color = quad[2].color = quad[3].color = c;
+        }
+
+        target.draw(&vertices[0], aliveCount * 4, sf::Quads);
+    }
+
+private:
+    std::size_t capacity;
+    std::size_t aliveCount = 0;
+    std::vector<float> posX, posY;
+    std::vector<float> velX, velY;
+    std::vector<float> accX, accY;
+    std::vector<float> life, invMaxLife;
+    std::vector<float> size;
+    std::vector<sf::Color> color;
+    sf::VertexArray vertices;
+    std::mt19937 rng;
+
+    void spawn(float x, float y, float vx, float vy, float ax, float ay,
+        float lifetime, float particleSize, sf::Color c) {
+        if (aliveCount >= capacity) return;
+        std::size_t i = aliveCount++;
+        posX[i] = x;
+        posY[i] = y;
+        velX[i] = vx;
+        velY[i] = vy;
+        accX[i] = ax;
+        accY[i] = ay;
+        life[i] = lifetime;
+        invMaxLife[i] = 1.f / lifetime;
+        size[i] = particleSize;
+        color[i] = c;
+    }
+
+    void compact() {
+        std::size_t i = 0;
+        while (i < aliveCount) {
+            if (life[i] <= 0.f) {
+                std::size_t last = --aliveCount;
+                posX[i] = posX[last];
+                posY[i] = posY[last];
+                velX[i] = velX[last];
+                velY[i] = velY[last];
+                accX[i] = accX[last];
+                accY[i] = accY[last];
+                life[i] = life[last];
+                invMaxLife[i] = invMaxLife[last];
+                size[i] = size[last];
+                color[i] = color[last];
+            }
+            else {
+                ++i;
+            }
+        }
+    }
+};
+
+// Compares the scalar and SIMD particle integration kernels on a full pool
+void runParticleBenchmark() {
+    const int iterations = 2000;
+    const float dt = 1.f / 60.f;
+    sf::Vector2u area(1920, 1080);
+
+    auto measure = [&](bool simd) {
+        ParticleSystem particles;
+        // Long lifetimes so the pool stays full for the whole run
+        while (particles.getAliveCount() < particles.getCapacity()) {
+            particles.emitConfetti(area, 1024);
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            if (simd) particles.integrateSimd(dt * 0.001f);
+            else particles.integrateScalar(dt * 0.001f);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double us = std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+        std::cout << (simd ? "simd   " : "scalar ") << particles.getAliveCount()
+            << " particles: " << std::fixed << std::setprecision(2) << us << " us/update" << std::endl;
+    };
+
+    measure(false);
+    measure(true);
+}
+
+// Update-pass cost of screens of a few hundred to a few thousand buttons with
+// the pointer sweeping across them, and the heap allocations made rebuilding
+// such a screen in slots the pool has used before
+void runWidgetBenchmark() {
+    const int passes = 2000;
+    const int columns = 40;
+    for (int count : { 100, 400, 1600 }) {
+        WidgetPool pool(static_cast<std::size_t>(count));
+        std::vector<WidgetPool::Handle> screen;
+        screen.reserve(count);
+        auto build = [&] {
+            for (int i = 0; i < count; ++i) {
+                sf::FloatRect rect((i % columns) * 48.f, (i / columns) * 24.f, 44.f, 20.f);
+                screen.push_back(pool.create("W", rect, UiCommand(), i, 12));
+            }
+        };
+        build();
+
+        CommandQueue commands;
+        auto start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < passes; ++pass) {
+            sf::Vector2i mouse((pass * 7) % (columns * 48), (pass * 3) % (count / columns * 24));
+            pool.update(screen.data(), screen.size(), mouse, nullptr, true, commands);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double us = std::chrono::duration<double, std::micro>(end - start).count() / passes;
+
+        for (WidgetPool::Handle handle : screen) pool.release(handle);
+        screen.clear();
+        std::uint64_t allocationsBefore = AllocationTracker::local().allocations;
+        build();
+        std::uint64_t allocations = AllocationTracker::local().allocations - allocationsBefore;
+
+        std::cout << std::setw(5) << count << " widgets: " << std::fixed << std::setprecision(2) << us << " us/update ("
+            << us * 1000.0 / count << " ns/widget), rebuild " << allocations << " allocations" << std::endl;
+        for (WidgetPool::Handle handle : screen) pool.release(handle);
+    }
+}
+
+// Draws the static stack of the Achievements screen at 1080p, directly and from
+// a cached layer, and reports pixels touched and time per frame for each
+void runLayerBenchmark() {
+    const unsigned width = 1920;
+    const unsigned height = 1080;
+    const int frames = 300;
+    const float scale = std::min(width / 800.f, height / 600.f);
+
+    sf::RenderTexture target;
+    sf::RenderTexture cache;
+    if (!target.create(width, height) || !cache.create(width, height)) {
+        std::cerr << "Error: Failed to create 1080p render textures" << std::endl;
+        return;
+    }
+
+    sf::Sprite background(ResourceManager::getBackgroundTexture(sf::Vector2u(width, height)));
+    sf::Vector2u textureSize = background.getTexture()->getSize();
+    background.setScale(width / static_cast<float>(textureSize.x), height / static_cast<float>(textureSize.y));
+
+    sf::RectangleShape overlay(sf::Vector2f(static_cast<float>(width), static_cast<float>(height)));
+    overlay.setFillColor(sf::Color(0, 0, 0, 150));
+
+    sf::RectangleShape panel(sf::Vector2f(width - 100.f * scale, height - 200.f * scale));
+    panel.setPosition(50.f * scale, 120.f * scale);
+    panel.setFillColor(sf::Color(0, 0, 0, 150));
+
+    auto paintDirect = [&](sf::RenderTarget& t) {
+        t.clear();
+        t.draw(background);
+        t.draw(overlay);
+        t.draw(panel);
+    };
+    paintDirect(cache);
+    cache.display();
+    sf::Sprite cached(cache.getTexture());
+
+    auto measure = [&](const char* name, double pixels, const std::function<void()>& paint) {
+        target.getTexture().copyToImage();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; ++i) {
+            paint();
+            target.display();
+        }
+        // Reading back forces the GPU to finish the queued frames
+        target.getTexture().copyToImage();
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count() / frames;
+        std::cout << name << std::fixed << std::setprecision(1) << pixels / 1e6 << " Mpx/frame, "
+            << std::setprecision(3) << ms << " ms/frame" << std::endl;
+    };
+
+    double screen = static_cast<double>(width) * height;
+    double direct = screen * 3 + panel.getSize().x * panel.getSize().y;
+    measure("direct ", direct, [&]() { paintDirect(target); });
+    measure("cached ", screen, [&]() { target.draw(cached, sf::RenderStates(sf::BlendNone)); });
+    std::cout << "fill saved: " << std::setprecision(0) << (1.0 - screen / direct) * 100.0 << "%" << std::endl;
+}
+
+// Lock-free single-producer/single-consumer triple buffer. The writer always
+// has a private slot to fill, the reader always holds the latest complete one.
+template <typename T>
+class TripleBuffer {
+public:
+    T& writeBuffer() { return buffers[writeIndex]; }
+    const T& readBuffer() const { return buffers[readIndex]; }
+
+    void publish() {
+        writeIndex = shared.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Swaps in the newest published buffer, returns false if nothing new arrived
+    bool fetch() {
+        if (!(shared.load(std::memory_order_relaxed) & FRESH)) return false;
+        readIndex = shared.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+private:
+    static const int INDEX_MASK = 3;
+    static const int FRESH = 4;
+
+    std::array<T, 3> buffers;
+    std::atomic<int> shared{ 1 };
+    int writeIndex = 0;
+    int readIndex = 2;
+};
+
+// Bounded lock-free single-producer/single-consumer queue
+template <typename T, std::size_t Capacity>
+class SpscQueue {
+public:
+    bool push(const T& item) {
+        std::size_t tail = tailIndex.load(std::memory_order_relaxed);
+        std::size_t next = (tail + 1) % Capacity;
+        if (next == headIndex.load(std::memory_order_acquire)) return false;
+        items[tail] = item;
+        tailIndex.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        std::size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire)) return false;
+        item = items[head];
+        headIndex.store((head + 1) % Capacity, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> items;
+    std::atomic<std::size_t> headIndex{ 0 };
+    std::atomic<std::size_t> tailIndex{ 0 };
+};
+
+// Collects duration samples and reports percentiles at shutdown. Past
+// MAX_SAMPLES it keeps a uniform random sample of everything recorded
+// (reservoir sampling), so a long session is described as a whole rather
+// than by its first minutes; the maximum is always exact.
+class PerfStats {
+public:
+    static const std::size_t MAX_SAMPLES = 1 << 16;
+
+    explicit PerfStats(const std::string& name) : name(name) {
+        samples.reserve(MAX_SAMPLES);
+    }
+
+    void record(sf::Int64 micros) {
+        ++recorded;
+        longest = std::max(longest, micros);
+        if (samples.size() < MAX_SAMPLES) {
+            samples.push_back(micros);
+            return;
+        }
+        // xorshift64: cheap, and good enough to pick which sample to replace
+        rngState ^= rngState << 13;
+        rngState ^= rngState >> 7;
+        rngState ^= rngState << 17;
+        std::uint64_t slot = rngState % recorded;
+        if (slot < MAX_SAMPLES) samples[static_cast<std::size_t>(slot)] = micros;
+    }
+
+    void report(std::ostream& out) const {
+        if (samples.empty()) {
+            out << name << ": no samples" << std::endl;
+            return;
+        }
+        std::vector<sf::Int64> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&](double p) {
+            return sorted[static_cast<std::size_t>(p * (sorted.size() - 1))] / 1000.0;
+        };
+        out << name << " (" << recorded << " samples";
+        if (recorded > sorted.size()) out << ", percentiles from a random " << sorted.size();
+        out << ") ms: p50 " << std::fixed << std::setprecision(2)
+            << percentile(0.5) << ", p95 " << percentile(0.95) << ", p99 " << percentile(0.99)
+            << ", max " << longest / 1000.0 << std::endl;
+    }
+
+private:
+    std::string name;
+    std::vector<sf::Int64> samples;
+    std::uint64_t recorded = 0;
+    sf::Int64 longest = 0;
+    std::uint64_t rngState = 0x9E3779B97F4A7C15ull;
+};
+
+// Trades visual quality for render time. Frames are judged in windows of
+// WINDOW_FRAMES: a window where more than one frame in ten misses the budget
+// lowers quality one level, and a run of windows that all finish in under
+// half the budget raises it again. Raising right back into a miss doubles
+// the run needed next time, so a scene sitting on the budget does not flap.
+class QualityGovernor {
+public:
+    enum Level { FULL, REDUCED, LOW, MINIMAL };
+    static const int LEVEL_COUNT = 4;
+
+    explicit QualityGovernor(sf::Int64 budgetMicros = 16667) : budget(budgetMicros) {}
+
+    // Returns true when this frame changed the level
+    bool recordFrame(sf::Int64 costMicros) {
+        ++framesAtLevel[current];
+        ++windowFrames;
+        windowCost += costMicros;
+        if (costMicros > budget) ++windowMisses;
+        if (windowFrames < WINDOW_FRAMES) return false;
+
+        bool missed = windowMisses * 10 > windowFrames;
+        bool headroom = windowMisses == 0 && windowCost < budget * windowFrames / 2;
+        lastWindowMean = windowCost / windowFrames;
+        windowFrames = windowMisses = 0;
+        windowCost = 0;
+        ++windowsAtLevel;
+
+        if (missed && current < MINIMAL) {
+            if (lastChangeRaised && windowsAtLevel <= 2 && calmWindowsNeeded < MAX_CALM_WINDOWS) {
+                calmWindowsNeeded *= 2;
+            }
+            changeLevel(static_cast<Level>(current + 1), false);
+            return true;
+        }
+        calmWindows = headroom ? calmWindows + 1 : 0;
+        if (calmWindows >= calmWindowsNeeded && current > FULL) {
+            changeLevel(static_cast<Level>(current - 1), true);
+            return true;
+        }
+        return false;
+    }
+
+    Level level() const { return current; }
+    sf::Int64 getBudget() const { return budget; }
+    sf::Int64 getLastWindowMean() const { return lastWindowMean; }
+
+    // What each level gives up; every level keeps the cuts of the ones above it
+    static bool animatesTitleOutline(Level level) { return level == FULL; }
+    static bool animatesHover(Level level) { return level < LOW; }
+    static bool animatesTitle(Level level) { return level < MINIMAL; }
+    static float backgroundScale(Level level) { return level >= LOW ? 0.5f : 1.f; }
+    static float particleFraction(Level level) {
+        static const float fractions[LEVEL_COUNT] = { 1.f, 0.5f, 0.25f, 0.1f };
+        return fractions[level];
+    }
+    static unsigned frameRateCap(Level level) { return level == MINIMAL ? 30u : 0u; }
+
+    static const char* levelName(Level level) {
+        static const char* names[LEVEL_COUNT] = { "full", "reduced", "low", "minimal" };
+        return names[level];
+    }
+
+    void report(std::ostream& out) const {
+        out << "quality (" << levelName(current) << " at exit) frames:";
+        for (int i = 0; i < LEVEL_COUNT; ++i) {
+            out << (i ? ", " : " ") << levelName(static_cast<Level>(i)) << " " << framesAtLevel[i];
+        }
+        out << std::endl;
+    }
+
+private:
+    static const int WINDOW_FRAMES = 60;
+    static const int MIN_CALM_WINDOWS = 5;
+    static const int MAX_CALM_WINDOWS = 80;
+
+    void changeLevel(Level level, bool raised) {
+        current = level;
+        lastChangeRaised = raised;
+        calmWindows = 0;
+        windowsAtLevel = 0;
+    }
+
+    sf::Int64 budget;
+    Level current = FULL;
+    int windowFrames = 0;
+    int windowMisses = 0;
+    sf::Int64 windowCost = 0;
+    sf::Int64 lastWindowMean = 0;
+    int windowsAtLevel = 0;
+    int calmWindows = 0;
+    int calmWindowsNeeded = MIN_CALM_WINDOWS;
+    bool lastChangeRaised = false;
+    std::array<std::uint64_t, LEVEL_COUNT> framesAtLevel{};
+};
+
+// Records presented frames without stalling the frame that produced them.
+// Each frame is first copied GPU-side into a small ring of textures, and the
+// copy made RING_SIZE frames earlier is read back in its place, long after
+// the GPU finished it. Pixels reach the encoder thread through a fixed pool
+// of buffers; a frame that finds the pool empty is dropped, never waited for.
+// A path ending in .y4m gets a raw YUV4MPEG2 stream with each frame's time in
+// its header, anything else is a directory (created if missing) for a PNG
+// sequence plus timestamps.csv.
+class FrameRecorder {
+public:
+    FrameRecorder(const std::string& path, sf::Vector2u size)
+        : path(path), size(size), y4m(path.size() > 4 && path.compare(path.size() - 4, 4, ".y4m") == 0) {
+        for (auto& slot : ring) {
+            if (!slot.texture.create(size.x, size.y)) {
+                throw std::runtime_error("Failed to create capture textures!");
+            }
+        }
+        for (int i = 0; i < POOL_SIZE; ++i) {
+            pool[i].pixels.resize(static_cast<std::size_t>(size.x) * size.y * 4);
+            freeBuffers.push(i);
+        }
+        rowScratch.resize(static_cast<std::size_t>(size.x) * 4);
+
+        if (y4m) {
+            output.open(path, std::ios::binary | std::ios::trunc);
+            // The nominal rate only matters to players that ignore the per-frame times
+            output << "YUV4MPEG2 W" << size.x << " H" << size.y << " F60:1 Ip A1:1 C420jpeg\n";
+        }
+        else {
+            std::error_code error;
+            std::filesystem::create_directories(path, error);
+            if (error) {
+                throw std::runtime_error("Failed to create capture directory " + path + ": " + error.message());
+            }
+            output.open(path + "/timestamps.csv", std::ios::trunc);
+            output << "frame,microseconds\n";
+        }
+        if (!output) {
+            throw std::runtime_error("Failed to open capture output " + path);
+        }
+        worker = std::thread(&FrameRecorder::encodeLoop, this);
+    }
+
+    // Frames still in the texture ring at shutdown are not recorded
+    ~FrameRecorder() {
+        running = false;
+        worker.join();
+        std::cout << "capture: " << encoded << " frames written to " << path << ", "
+            << dropped << " dropped" << std::endl;
+    }
+
+    FrameRecorder(const FrameRecorder&) = delete;
+    FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+    // Copies the window's back buffer, so it must run before display()
+    void capture(const sf::Window& window, sf::Int64 stamp) {
+        if (!matches(window.getSize())) return;
+        Slot& slot = nextSlot();
+        slot.texture.update(window);
+        slot.stamp = stamp;
+        slot.flipped = true;
+        slot.filled = true;
+    }
+
+    // For offscreen targets, after their display()
+    void capture(const sf::Texture& texture, sf::Int64 stamp) {
+        if (!matches(texture.getSize())) return;
+        Slot& slot = nextSlot();
+        // The texture-to-texture copy rights a RenderTexture's flipped rows
+        slot.texture.update(texture);
+        slot.stamp = stamp;
+        slot.flipped = false;
+        slot.filled = true;
+    }
+
+private:
+    static const int RING_SIZE = 3;
+    static const int POOL_SIZE = 6;
+
+    struct Slot {
+        sf::Texture texture;
+        sf::Int64 stamp = 0;
+        bool flipped = false;
+        bool filled = false;
+    };
+    struct Buffer {
+        std::vector<sf::Uint8> pixels;
+        sf::Int64 stamp = 0;
+    };
+
+    bool matches(sf::Vector2u frameSize) {
+        if (frameSize == size) return true;
+        if (!sizeWarned) {
+            std::cerr << "Warning: window size changed, capture skips frames until it is restored" << std::endl;
+            sizeWarned = true;
+        }
+        ++dropped;
+        return false;
+    }
+
+    // Hands the oldest copy to the encoder and returns its slot for reuse
+    Slot& nextSlot() {
+        Slot& slot = ring[nextIndex];
+        nextIndex = (nextIndex + 1) % RING_SIZE;
+        if (!slot.filled) return slot;
+        slot.filled = false;
+
+        int index;
+        if (!freeBuffers.pop(index)) {
+            ++dropped;
+            return slot;
+        }
+        readBack(slot, pool[index].pixels.data());
+        if (firstStamp < 0) firstStamp = slot.stamp;
+        pool[index].stamp = slot.stamp - firstStamp;
+        readyBuffers.push(index);
+        return slot;
+    }
+
+    // What Texture::copyToImage does, minus the sf::Image it would allocate
+    // every captured frame: the pixels land straight in a pooled buffer. A copy
+    // of the window is stored bottom row first, so like copyToImage it swaps
+    // the rows back before the encoder sees them.
+    void readBack(const Slot& slot, sf::Uint8* pixels) {
+        GLint previous = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+        glBindTexture(GL_TEXTURE_2D, slot.texture.getNativeHandle());
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(previous));
+        if (!slot.flipped) return;
+
+        const std::size_t stride = rowScratch.size();
+        sf::Uint8* top = pixels;
+        sf::Uint8* bottom = pixels + stride * (size.y - 1);
+        for (; top < bottom; top += stride, bottom -= stride) {
+            std::memcpy(rowScratch.data(), top, stride);
+            std::memcpy(top, bottom, stride);
+            std::memcpy(bottom, rowScratch.data(), stride);
+        }
+    }
+
+    void encodeLoop() {
+        for (;;) {
+            int index;
+            if (readyBuffers.pop(index)) {
+                encode(pool[index]);
+                freeBuffers.push(index);
+                continue;
+            }
+            if (!running) {
+                // A frame pushed just before shutdown is still worth writing
+                while (readyBuffers.pop(index)) encode(pool[index]);
+                return;
+            }
+            sf::sleep(sf::milliseconds(2));
+        }
+    }
+
+    void encode(const Buffer& buffer) {
+        if (y4m) {
+            writeY4mFrame(buffer);
+        }
+        else {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/frame_%06llu.png", static_cast<unsigned long long>(encoded));
+            sf::Image image;
+            image.create(size.x, size.y, buffer.pixels.data());
+            if (!image.saveToFile(path + name)) {
+                std::cerr << "Warning: Failed to write capture frame " << path + name << std::endl;
+            }
+            output << encoded << "," << buffer.stamp << "\n";
+        }
+        ++encoded;
+    }
+
+    // Full-range BT.601 with 2x2 averaged chroma, the layout C420jpeg declares
+    void writeY4mFrame(const Buffer& buffer) {
+        const unsigned chromaW = (size.x + 1) / 2;
+        const unsigned chromaH = (size.y + 1) / 2;
+        planes.resize(static_cast<std::size_t>(size.x) * size.y + 2 * chromaW * chromaH);
+        sf::Uint8* lumaPlane = planes.data();
+        sf::Uint8* uPlane = lumaPlane + static_cast<std::size_t>(size.x) * size.y;
+        sf::Uint8* vPlane = uPlane + chromaW * chromaH;
+        const sf::Uint8* rgba = buffer.pixels.data();
+
+        for (unsigned y = 0; y < size.y; ++y) {
+            for (unsigned x = 0; x < size.x; ++x) {
+                const sf::Uint8* p = rgba + (static_cast<std::size_t>(y) * size.x + x) * 4;
+                lumaPlane[static_cast<std::size_t>(y) * size.x + x] =
+                    static_cast<sf::Uint8>((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+            }
+        }
+        for (unsigned cy = 0; cy < chromaH; ++cy) {
+            for (unsigned cx = 0; cx < chromaW; ++cx) {
+                int r = 0, g = 0, b = 0, n = 0;
+                for (unsigned y = cy * 2; y < std::min(cy * 2 + 2, size.y); ++y) {
+                    for (unsigned x = cx * 2; x < std::min(cx * 2 + 2, size.x); ++x) {
+                        const sf::Uint8* p = rgba + (static_cast<std::size_t>(y) * size.x + x) * 4;
+                        r += p[0];
+                        g += p[1];
+                        b += p[2];
+                        ++n;
+                    }
+                }
+                r /= n;
+                g /= n;
+                b /= n;
+                // Pure blue and red round up to 256
+                uPlane[cy * chromaW + cx] = static_cast<sf::Uint8>(std::min(255, ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128));
+                vPlane[cy * chromaW + cx] = static_cast<sf::Uint8>(std::min(255, ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128));
+            }
+        }
+
+        output << "FRAME Xts=" << buffer.stamp << "\n";
+        output.write(reinterpret_cast<const char*>(planes.data()), static_cast<std::streamsize>(planes.size()));
+    }
+
+    std::string path;
+    sf::Vector2u size;
+    bool y4m;
+    std::ofstream output;
+
+    // Render thread
+    std::array<Slot, RING_SIZE> ring;
+    std::vector<sf::Uint8> rowScratch;
+    int nextIndex = 0;
+    sf::Int64 firstStamp = -1;
+    bool sizeWarned = false;
+
+    // Buffer indices move render -> encoder through readyBuffers and back through freeBuffers
+    std::array<Buffer, POOL_SIZE> pool;
+    SpscQueue<int, POOL_SIZE + 1> readyBuffers;
+    SpscQueue<int, POOL_SIZE + 1> freeBuffers;
+    std::atomic<std::uint64_t> dropped{ 0 };
+
+    // Encoder thread
+    std::vector<sf::Uint8> planes;
+    std::uint64_t encoded = 0;
+    std::atomic<bool> running{ true };
+    std::thread worker;
+};
+
+// Resource use of this process at one point of a soak run. Memory and file
+// handles come from /proc and glibc, so elsewhere they read as zero and the
+// drift check skips them.
+struct ResourceSample {
+    double minutes;
+    std::size_t residentBytes;
+    std::size_t heapBytes;
+    std::size_t textures;
+    std::size_t openFiles;
+    double frameP50;        // ms spent drawing a frame since the previous sample
+    double frameP99;
+};
+
+// Samples resource use and render cost through a long scripted run, appends
+// each sample to a CSV file and judges drift at the end. The baseline is the
+// first sample after warm-up, by which time every lazily built screen and
+// texture exists, so growth past it is a leak rather than a cache filling.
+class SoakMonitor {
+public:
+    static const std::size_t TAIL_SAMPLES = 3;      // median of these is compared with the baseline
+    static const std::size_t FILE_SLACK = 2;        // handles a log rollover may briefly hold open
+    static constexpr double FRAME_TOLERANCE = 0.5;  // allowed p99 growth, plus one millisecond
+
+    SoakMonitor(const std::string& csvPath, double memoryTolerance)
+        : file(csvPath), memoryTolerance(memoryTolerance) {
+        if (!file) {
+            throw std::runtime_error("Failed to open soak report " + csvPath + "!");
+        }
+        file << "minutes,rss_bytes,heap_bytes,textures,open_files,frame_p50_ms,frame_p99_ms\n";
+        frameCosts.reserve(1 << 16);
+    }
+
+    void recordFrame(sf::Int64 micros) {
+        if (frameCosts.size() < frameCosts.capacity()) frameCosts.push_back(micros);
+    }
+
+    void sample(double minutes, std::size_t textures) {
+        ResourceSample sample = { minutes, residentBytes(), heapBytes(), textures, openFiles(), 0.0, 0.0 };
+        if (!frameCosts.empty()) {
+            std::sort(frameCosts.begin(), frameCosts.end());
+            sample.frameP50 = frameCosts[(frameCosts.size() - 1) / 2] / 1000.0;
+            sample.frameP99 = frameCosts[static_cast<std::size_t>(0.99 * (frameCosts.size() - 1))] / 1000.0;
+            frameCosts.clear();
+        }
+        samples.push_back(sample);
+
+        // Flushed per line, so a run that is killed still leaves its curve behind
+        file << std::fixed << std::setprecision(2) << sample.minutes << "," << sample.residentBytes << ","
+            << sample.heapBytes << "," << sample.textures << "," << sample.openFiles << ","
+            << sample.frameP50 << "," << sample.frameP99 << std::endl;
+    }
+
+    // Returns false when a metric drifted past its threshold, or when the run
+    // was too short to leave TAIL_SAMPLES after the warm-up
+    bool check(double warmupMinutes, std::ostream& out) const {
+        std::size_t base = 0;
+        while (base < samples.size() && samples[base].minutes < warmupMinutes) ++base;
+        if (samples.size() < base + 1 + TAIL_SAMPLES) {
+            out << "soak: " << samples.size() << " samples, too few after " << warmupMinutes
+                << " min of warm-up to judge drift" << std::endl;
+            return false;
+        }
+
+        const ResourceSample& baseline = samples[base];
+        bool passed = true;
+        auto judge = [&](const char* name, double before, double after, double limit, const char* unit) {
+            bool drifted = after > limit;
+            passed = passed && !drifted;
+            out << "soak " << name << ": " << std::fixed << std::setprecision(2) << before << " -> " << after
+                << " " << unit << " (limit " << limit << ")" << (drifted ? "  DRIFT" : "") << std::endl;
+        };
+
+        const double mb = 1024.0 * 1024.0;
+        double rss = tailMedian(&ResourceSample::residentBytes) / mb;
+        double heap = tailMedian(&ResourceSample::heapBytes) / mb;
+        if (baseline.residentBytes > 0) {
+            judge("rss", baseline.residentBytes / mb, rss, baseline.residentBytes / mb * (1.0 + memoryTolerance), "MB");
+        }
+        if (baseline.heapBytes > 0) {
+            judge("heap", baseline.heapBytes / mb, heap, baseline.heapBytes / mb * (1.0 + memoryTolerance), "MB");
+        }
+        judge("textures", static_cast<double>(baseline.textures), tailMedian(&ResourceSample::textures),
+            static_cast<double>(baseline.textures), "");
+        if (baseline.openFiles > 0) {
+            judge("open files", static_cast<double>(baseline.openFiles), tailMedian(&ResourceSample::openFiles),
+                static_cast<double>(baseline.openFiles + FILE_SLACK), "");
+        }
+        if (baseline.frameP99 > 0) {
+            judge("frame p99", baseline.frameP99, tailMedian(&ResourceSample::frameP99),
+                baseline.frameP99 * (1.0 + FRAME_TOLERANCE) + 1.0, "ms");
+        }
+        out << "soak: " << (passed ? "passed" : "FAILED") << " over " << samples.back().minutes << " min, "
+            << samples.size() << " samples" << std::endl;
+        return passed;
+    }
+
+private:
+    template <typename T>
+    double tailMedian(T ResourceSample::* field) const {
+        std::vector<double> tail;
+        for (std::size_t i = samples.size() - TAIL_SAMPLES; i < samples.size(); ++i) {
+            tail.push_back(static_cast<double>(samples[i].*field));
+        }
+        std::sort(tail.begin(), tail.end());
+        return tail[tail.size() / 2];
+    }
+
+    static std::size_t residentBytes() {
+#ifdef SHAOLIN_HAS_PROCFS
+        std::ifstream statm("/proc/self/statm");
+        std::size_t pages = 0, resident = 0;
+        if (statm >> pages >> resident) return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+        return 0;
+    }
+
+    // Bytes the allocator has handed out, including blocks it mapped directly
+    static std::size_t heapBytes() {
+#ifdef SHAOLIN_HAS_MALLINFO2
+        struct mallinfo2 info = mallinfo2();
+        return info.uordblks + info.hblkhd;
+#else
+        return 0;
+#endif
+    }
+
+    static std::size_t openFiles() {
+        std::size_t count = 0;
+#ifdef SHAOLIN_HAS_PROCFS
+        if (DIR* fds = opendir("/proc/self/fd")) {
+            while (dirent* entry = readdir(fds)) {
+                if (entry->d_name[0] != '.') ++count;
+            }
+            closedir(fds);
+            if (count > 0) --count;     // the handle of the listing itself
+        }
+#endif
+        return count;
+    }
+
+    std::ofstream file;
+    double memoryTolerance;
+    std::vector<sf::Int64> frameCosts;
+    std::vector<ResourceSample> samples;
+};
+
+// Decodes one music file ahead of playback on its own thread, into a ring of
+// samples the mixer drains from the audio thread. Only the decoder thread
+// touches the file and only the mixer reads the ring, so neither ever waits.
+class TrackDecoder {
+public:
+    TrackDecoder() = default;
+    ~TrackDecoder() { stop(); }
+
+    TrackDecoder(const TrackDecoder&) = delete;
+    TrackDecoder& operator=(const TrackDecoder&) = delete;
+
+    bool open(const std::string& path, float aheadSeconds) {
+        if (!file.openFromFile(path)) return false;
+        capacity = static_cast<std::size_t>(aheadSeconds * file.getSampleRate() * file.getChannelCount());
+        if (capacity < CHUNK_SAMPLES) capacity = CHUNK_SAMPLES;
+        ring.assign(capacity, 0);
+        totalSamples = file.getSampleCount();
+        running = true;
+        worker = std::thread(&TrackDecoder::decodeLoop, this);
+        return true;
+    }
+
+    void stop() {
+        running = false;
+        if (worker.joinable()) worker.join();
+    }
+
+    unsigned getChannelCount() const { return file.getChannelCount(); }
+    unsigned getSampleRate() const { return file.getSampleRate(); }
+
+    std::size_t buffered() const {
+        return written.load(std::memory_order_acquire) - consumed.load(std::memory_order_relaxed);
+    }
+
+    bool decodedAll() const { return endOfFile.load(std::memory_order_acquire); }
+    bool exhausted() const { return decodedAll() && buffered() == 0; }
+
+    // Samples still to be played; the count in the header can be an estimate for MP3
+    std::uint64_t remaining() const {
+        std::uint64_t played = consumed.load(std::memory_order_relaxed);
+        if (decodedAll() || played >= totalSamples) return buffered();
+        return std::max<std::uint64_t>(totalSamples - played, buffered());
+    }
+
+    // Audio thread only
+    std::size_t read(sf::Int16* out, std::size_t count) {
+        std::size_t readIndex = consumed.load(std::memory_order_relaxed);
+        std::size_t available = written.load(std::memory_order_acquire) - readIndex;
+        std::size_t n = std::min(count, available);
+        for (std::size_t i = 0; i < n; ++i) {
+            out[i] = ring[(readIndex + i) % capacity];
+        }
+        consumed.store(readIndex + n, std::memory_order_release);
+        return n;
+    }
+
+private:
+    static const std::size_t CHUNK_SAMPLES = 4096;
+
+    void decodeLoop() {
+        std::array<sf::Int16, CHUNK_SAMPLES> chunk;
+        while (running) {
+            std::size_t writeIndex = written.load(std::memory_order_relaxed);
+            std::size_t free = capacity - (writeIndex - consumed.load(std::memory_order_acquire));
+            if (free < CHUNK_SAMPLES) {
+                sf::sleep(sf::milliseconds(5));
+                continue;
+            }
+            std::size_t got = static_cast<std::size_t>(file.read(chunk.data(), CHUNK_SAMPLES));
+            for (std::size_t i = 0; i < got; ++i) {
+                ring[(writeIndex + i) % capacity] = chunk[i];
+            }
+            written.store(writeIndex + got, std::memory_order_release);
+            if (got < CHUNK_SAMPLES) {
+                endOfFile.store(true, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    sf::InputSoundFile file;
+    std::uint64_t totalSamples = 0;
+    std::vector<sf::Int16> ring;
+    std::size_t capacity = 0;
+    std::atomic<std::size_t> written{ 0 };
+    std::atomic<std::size_t> consumed{ 0 };
+    std::atomic<bool> endOfFile{ false };
+    std::atomic<bool> running{ false };
+    std::thread worker;
+};
+
+// Streams music through a single SFML stream and crossfades between tracks.
+// Tracks are queued from the game thread with their decoder already running;
+// the audio thread switches to one only once it has PREBUFFER_SECONDS decoded,
+// immediately for a change of mood or CROSSFADE_SECONDS before the end of the
+// playing track for the next entry of a playlist, so consecutive tracks
+// overlap instead of leaving a gap. The stream's format is fixed by the first
+// track, and later tracks must match it.
+class MusicPlayer : private sf::SoundStream {
+public:
+    static constexpr float CROSSFADE_SECONDS = 2.f;
+
+    ~MusicPlayer() {
+        stop();
+        Request request;
+        while (incoming.pop(request)) delete request.decoder;
+        collectRetired();
+        delete waiting;
+        delete outgoing;
+        delete current;
+    }
+
+    using sf::SoundSource::setVolume;
+
+    // Game thread. With atEnd the track follows the playing one, otherwise it
+    // fades in as soon as it is buffered
+    bool queueTrack(const std::string& path, bool atEnd) {
+        std::unique_ptr<TrackDecoder> decoder(new TrackDecoder());
+        if (!decoder->open(path, DECODE_AHEAD_SECONDS)) return false;
+
+        if (channelCount == 0) {
+            if (decoder->getChannelCount() > MAX_CHANNELS) {
+                std::cerr << "Warning: " << path << " has more than " << MAX_CHANNELS << " channels, skipping it" << std::endl;
+                return false;
+            }
+            channelCount = decoder->getChannelCount();
+            sampleRate = decoder->getSampleRate();
+            fadeFrames = static_cast<std::size_t>(CROSSFADE_SECONDS * sampleRate);
+            prebufferSamples = static_cast<std::size_t>(PREBUFFER_SECONDS * sampleRate) * channelCount;
+            initialize(channelCount, sampleRate);
+        }
+        else if (decoder->getChannelCount() != channelCount || decoder->getSampleRate() != sampleRate) {
+            std::cerr << "Warning: " << path << " does not match the music format ("
+                << channelCount << " channels, " << sampleRate << " Hz), skipping it" << std::endl;
+            return false;
+        }
+
+        Request request = { decoder.get(), atEnd };
+        if (!incoming.push(request)) return false;
+        decoder.release();
+        ++queuedRequests;
+        if (getStatus() != sf::SoundSource::Playing) play();
+        return true;
+    }
+
+    // Game thread: frees the decoders the mixer has finished with
+    void collectRetired() {
+        TrackDecoder* decoder;
+        while (retired.pop(decoder)) delete decoder;
+    }
+
+    // True from queueTrack until the mixer has started that track
+    bool isSwitching() const { return queuedRequests != startedRequests.load(std::memory_order_acquire); }
+    float secondsLeft() const { return currentSecondsLeft; }
+    std::uint64_t getUnderruns() const { return underruns; }
+    float getLowestBufferedSeconds() const { return lowestBufferedSeconds; }
+
+private:
+    static constexpr float DECODE_AHEAD_SECONDS = 3.f;
+    static constexpr float PREBUFFER_SECONDS = 0.5f;
+    static const std::size_t MIX_FRAMES = 2048;
+    static const unsigned MAX_CHANNELS = 2;
+
+    struct Request {
+        TrackDecoder* decoder;
+        bool atEnd;
+    };
+
+    bool onGetData(Chunk& data) override {
+        Request request;
+        while (incoming.pop(request)) {
+            ++poppedRequests;
+            // A newer request replaces one that never started
+            if (waiting) retire(waiting);
+            waiting = request.decoder;
+            waitingAtEnd = request.atEnd;
+        }
+
+        if (waiting) {
+            bool ready = waiting->buffered() >= prebufferSamples || waiting->decodedAll();
+            bool due = !waitingAtEnd || !current || current->remaining() <= fadeFrames * channelCount;
+            if (ready && due) {
+                // A fade still in progress is cut short
+                if (outgoing) retire(outgoing);
+                outgoing = current;
+                current = waiting;
+                waiting = nullptr;
+                fadedFrames = 0;
+                currentSecondsLeft = static_cast<float>(current->remaining()) / (sampleRate * channelCount);
+                startedRequests.store(poppedRequests, std::memory_order_release);
+            }
+        }
+
+        const std::size_t samples = MIX_FRAMES * channelCount;
+        std::size_t got = current ? current->read(currentSamples.data(), samples) : 0;
+        if (current && got < samples && !current->decodedAll()) {
+            ++underruns;
+            Telemetry::get().musicUnderruns->add();
+        }
+        std::fill(currentSamples.begin() + got, currentSamples.begin() + samples, sf::Int16(0));
+
+        std::size_t outgoingGot = outgoing ? outgoing->read(outgoingSamples.data(), samples) : 0;
+        std::fill(outgoingSamples.begin() + outgoingGot, outgoingSamples.begin() + samples, sf::Int16(0));
+
+        // Equal-power crossfade, so the overlap does not dip in loudness
+        for (std::size_t frame = 0; frame < MIX_FRAMES; ++frame) {
+            float in = 1.f;
+            float out = 0.f;
+            if (outgoing && fadedFrames < fadeFrames) {
+                float t = static_cast<float>(fadedFrames++) / fadeFrames;
+                in = std::sin(t * 1.5707963f);
+                out = std::cos(t * 1.5707963f);
+            }
+            for (unsigned c = 0; c < channelCount; ++c) {
+                std::size_t i = frame * channelCount + c;
+                float mixed = currentSamples[i] * in + outgoingSamples[i] * out;
+                output[i] = static_cast<sf::Int16>(std::max(-32768.f, std::min(32767.f, mixed)));
+            }
+        }
+
+        if (outgoing && (fadedFrames >= fadeFrames || outgoing->exhausted())) {
+            retire(outgoing);
+            outgoing = nullptr;
+        }
+        if (current && current->exhausted()) {
+            retire(current);
+            current = nullptr;
+        }
+
+        float buffered = current ? static_cast<float>(current->buffered()) / (sampleRate * channelCount) : 0.f;
+        currentSecondsLeft = current ? static_cast<float>(current->remaining()) / (sampleRate * channelCount) : 0.f;
+        if (current && buffered < lowestBufferedSeconds) lowestBufferedSeconds = buffered;
+        Telemetry::get().musicBuffered->observe(static_cast<std::int64_t>(buffered * 1000));
+
+        data.samples = output.data();
+        data.sampleCount = samples;
+        return true;
+    }
+
+    void onSeek(sf::Time) override {}
+
+    // Decoders are deleted on the game thread: joining their thread here
+    // could hold up the audio callback
+    void retire(TrackDecoder* decoder) {
+        if (!retired.push(decoder)) delete decoder;
+    }
+
+    unsigned channelCount = 0;
+    unsigned sampleRate = 0;
+    std::size_t fadeFrames = 0;
+    std::size_t prebufferSamples = 0;
+
+    SpscQueue<Request, 8> incoming;
+    SpscQueue<TrackDecoder*, 32> retired;
+    std::uint64_t queuedRequests = 0;
+    std::atomic<std::uint64_t> startedRequests{ 0 };
+    std::atomic<float> currentSecondsLeft{ 0.f };
+    std::atomic<std::uint64_t> underruns{ 0 };
+    std::atomic<float> lowestBufferedSeconds{ DECODE_AHEAD_SECONDS };
+
+    // Audio thread
+    TrackDecoder* current = nullptr;
+    TrackDecoder* outgoing = nullptr;
+    TrackDecoder* waiting = nullptr;
+    bool waitingAtEnd = false;
+    std::uint64_t poppedRequests = 0;
+    std::size_t fadedFrames = 0;
+    std::array<sf::Int16, MIX_FRAMES * MAX_CHANNELS> currentSamples;
+    std::array<sf::Int16, MIX_FRAMES * MAX_CHANNELS> outgoingSamples;
+    std::array<sf::Int16, MIX_FRAMES * MAX_CHANNELS> output;
+};
+
+// Sound effects, addressed by handle so callers never touch a buffer
+enum SfxHandle { SFX_CLICK, SFX_WIN, SFX_LOSE, SFX_COUNT };
+enum SfxCategory { SFX_UI, SFX_GAME, SFX_CATEGORY_COUNT };
+
+// Fire-and-forget sound effects on a fixed pool of voices created at startup.
+// Each sound reserves a run of the pool, bound to its buffer once when it is
+// registered: binding a voice to a buffer registers it with that buffer, which
+// allocates, so nothing is rebound while the game runs. At most MAX_ACTIVE
+// voices play at once; past that a new sound takes the place of the
+// lowest-priority, oldest sound not above its own priority, or is dropped if
+// there is none. A sound whose own voices are all busy cuts off its oldest.
+class SfxEngine {
+public:
+    static const std::size_t VOICES = 12;
+    static const std::size_t MAX_ACTIVE = 8;
+
+    void registerSound(SfxHandle handle, const sf::SoundBuffer& buffer, SfxCategory category, int priority,
+        std::size_t voiceCount) {
+        if (voiceCount == 0 || nextVoice + voiceCount > VOICES) {
+            throw std::runtime_error("Not enough sound-effect voices to register every sound!");
+        }
+        sounds[handle] = { &buffer, category, priority, nextVoice, voiceCount };
+        for (std::size_t i = nextVoice; i < nextVoice + voiceCount; ++i) {
+            voices[i].sound.setBuffer(buffer);
+            voices[i].handle = handle;
+        }
+        nextVoice += voiceCount;
+    }
+
+    void setCategoryVolume(SfxCategory category, float percent) {
+        categoryVolume[category] = std::max(0.f, std::min(percent, 100.f));
+        for (Voice& voice : voices) {
+            if (voice.sound.getStatus() != sf::SoundSource::Stopped && sounds[voice.handle].category == category) {
+                voice.sound.setVolume(categoryVolume[category] * voice.gain);
+            }
+        }
+    }
+
+    // Returns false when the sound was dropped for lack of a voice
+    bool play(SfxHandle handle, float gain = 1.f) {
+        const Sound& sound = sounds[handle];
+        if (!sound.buffer) return false;
+        ++plays;
+
+        Voice* chosen = nullptr;
+        Voice* oldest = nullptr;
+        Voice* victim = nullptr;
+        std::size_t active = 0;
+        for (std::size_t i = 0; i < VOICES; ++i) {
+            Voice& voice = voices[i];
+            bool own = i >= sound.firstVoice && i < sound.firstVoice + sound.voiceCount;
+            if (voice.sound.getStatus() == sf::SoundSource::Stopped) {
+                if (own && !chosen) chosen = &voice;
+                continue;
+            }
+            ++active;
+            if (own && (!oldest || voice.started < oldest->started)) oldest = &voice;
+            int priority = sounds[voice.handle].priority;
+            int victimPriority = victim ? sounds[victim->handle].priority : 0;
+            if (!victim || priority < victimPriority
+                || (priority == victimPriority && voice.started < victim->started)) {
+                victim = &voice;
+            }
+        }
+
+        // Cutting off one of its own plays keeps the count where it was
+        if (!chosen) {
+            oldest->sound.stop();
+            chosen = oldest;
+            --active;
+            ++steals;
+            Telemetry::get().sfxSteals->add();
+        }
+        else if (active >= MAX_ACTIVE) {
+            if (sounds[victim->handle].priority > sound.priority) {
+                ++dropped;
+                Telemetry::get().sfxDropped->add();
+                return false;
+            }
+            victim->sound.stop();
+            --active;
+            ++steals;
+            Telemetry::get().sfxSteals->add();
+        }
+
+        chosen->gain = gain;
+        chosen->started = plays;
+        chosen->sound.setVolume(categoryVolume[sound.category] * gain);
+        chosen->sound.play();
+
+        ++active;
+        peakVoices = std::max(peakVoices, active);
+        Telemetry::get().sfxVoices->observe(static_cast<std::int64_t>(active));
+        return true;
+    }
+
+    void stopAll() {
+        for (Voice& voice : voices) voice.sound.stop();
+    }
+
+    std::size_t activeVoices() const {
+        std::size_t active = 0;
+        for (const Voice& voice : voices) {
+            if (voice.sound.getStatus() != sf::SoundSource::Stopped) ++active;
+        }
+        return active;
+    }
+
+    void report(std::ostream& out) const {
+        out << "sfx: " << plays << " plays, peak " << peakVoices << " of " << MAX_ACTIVE << " voices, "
+            << steals << " stolen, " << dropped << " dropped" << std::endl;
+    }
+
+private:
+    struct Sound {
+        const sf::SoundBuffer* buffer;
+        SfxCategory category;
+        int priority;
+        std::size_t firstVoice;
+        std::size_t voiceCount;
+    };
+
+    struct Voice {
+        sf::Sound sound;
+        SfxHandle handle = SFX_CLICK;
+        float gain = 1.f;
+        std::uint64_t started = 0;
+    };
+
+    std::array<Sound, SFX_COUNT> sounds = {};
+    std::array<Voice, VOICES> voices;
+    std::array<float, SFX_CATEGORY_COUNT> categoryVolume = { { 100.f, 100.f } };
+    std::uint64_t plays = 0;
+    std::uint64_t steals = 0;
+    std::uint64_t dropped = 0;
+    std::size_t nextVoice = 0;
+    std::size_t peakVoices = 0;
+};
+
+// Temperature band of a guess, from 0 (BOILING HOT) to 6 (FREEZING). A guess
+// is in the first band whose limit, in percent of the range, it falls below;
+// as the limits ascend that is the number of limits it reaches, which needs
+// no branches.
+const int TEMPERATURE_BANDS = 7;
+constexpr int TEMPERATURE_BAND_PERCENT[TEMPERATURE_BANDS - 1] = { 5, 10, 20, 30, 40, 60 };
+
+inline int temperatureBand(int distance, int range) {
+    int band = 0;
+    for (int i = 0; i < TEMPERATURE_BANDS - 1; ++i) {
+        band += distance * 100 >= TEMPERATURE_BAND_PERCENT[i] * range;
+    }
+    return band;
+}
+
+// Same bands with the range fixed at compile time, so every limit is a constant
+template <int Range>
+inline int temperatureBand(int distance) {
+    int band = 0;
+    for (int i = 0; i < TEMPERATURE_BANDS - 1; ++i) {
+        band += distance * 100 >= TEMPERATURE_BAND_PERCENT[i] * Range;
+    }
+    return band;
+}
+
+// One row of DIFFICULTY_RULES as compile-time constants
+template <int D>
+struct DifficultyTraits {
+    static constexpr int range = DIFFICULTY_RULES[D].range;
+    static constexpr int maxAttempts = DIFFICULTY_RULES[D].maxAttempts;
+    static constexpr int timeLimitSeconds = DIFFICULTY_RULES[D].timeLimitSeconds;
+    static constexpr int points = DIFFICULTY_RULES[D].points;
+};
+
+// Calls f(std::integral_constant<int, D>()) with D equal to the runtime difficulty,
+// so a generic lambda can pick the kernel specialized for it
+template <int D>
+struct DifficultyDispatch {
+    template <typename F>
+    static auto call(int difficulty, F& f) -> decltype(f(std::integral_constant<int, 0>())) {
+        if (difficulty == D) return f(std::integral_constant<int, D>());
+        return DifficultyDispatch<D + 1>::call(difficulty, f);
+    }
+};
+
+template <>
+struct DifficultyDispatch<DIFFICULTY_COUNT> {
+    template <typename F>
+    static auto call(int, F& f) -> decltype(f(std::integral_constant<int, 0>())) {
+        return f(std::integral_constant<int, 0>());
+    }
+};
+
+template <typename F>
+auto withDifficulty(int difficulty, F f) -> decltype(f(std::integral_constant<int, 0>())) {
+    return DifficultyDispatch<0>::call(difficulty, f);
+}
+
+struct GuessOutcome {
+    int band;
+    bool correct;
+};
+
+template <int D>
+inline GuessOutcome evaluateGuess(int guess, int secret) {
+    GuessOutcome outcome;
+    outcome.band = temperatureBand<DifficultyTraits<D>::range>(std::abs(guess - secret));
+    outcome.correct = guess == secret;
+    return outcome;
+}
+
+inline GuessOutcome evaluateGuess(int difficulty, int guess, int secret) {
+    return withDifficulty(difficulty, [&](auto d) { return evaluateGuess<decltype(d)::value>(guess, secret); });
+}
+
+struct SimulationResult {
+    int games = 0;
+    int won = 0;
+    std::int64_t guesses = 0;
+    std::array<int, TEMPERATURE_BANDS> bands{};
+};
+
+// Plays games with the Hint Helper direction hint, bisecting a random point of
+// the remaining interval each turn; used to benchmark the rule kernels
+template <int D>
+SimulationResult simulateGames(std::mt19937& rng, int games) {
+    typedef DifficultyTraits<D> Rules;
+    SimulationResult result;
+    for (int game = 0; game < games; ++game) {
+        int secret = std::uniform_int_distribution<int>(1, Rules::range)(rng);
+        int low = 1;
+        int high = Rules::range;
+        for (int attempts = 1; Rules::maxAttempts == 0 || attempts <= Rules::maxAttempts; ++attempts) {
+            int guess = std::uniform_int_distribution<int>(low, high)(rng);
+            GuessOutcome outcome = evaluateGuess<D>(guess, secret);
+            ++result.guesses;
+            ++result.bands[outcome.band];
+            if (outcome.correct) {
+                ++result.won;
+                break;
+            }
+            if (guess < secret) low = guess + 1;
+            else high = guess - 1;
+        }
+        ++result.games;
+    }
+    return result;
+}
+
+// Reference path for the benchmark: the same player with every rule read at run time
+inline SimulationResult simulateGames(int difficulty, std::mt19937& rng, int games) {
+    const DifficultyRules& rules = DIFFICULTY_RULES[difficulty];
+    SimulationResult result;
+    for (int game = 0; game < games; ++game) {
+        int secret = std::uniform_int_distribution<int>(1, rules.range)(rng);
+        int low = 1;
+        int high = rules.range;
+        for (int attempts = 1; rules.maxAttempts == 0 || attempts <= rules.maxAttempts; ++attempts) {
+            int guess = std::uniform_int_distribution<int>(low, high)(rng);
+            int band = temperatureBand(std::abs(guess - secret), rules.range);
+            ++result.guesses;
+            ++result.bands[band];
+            if (guess == secret) {
+                ++result.won;
+                break;
+            }
+            if (guess < secret) low = guess + 1;
+            else high = guess - 1;
+        }
+        ++result.games;
+    }
+    return result;
+}
+
+inline int popcount64(std::uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return static_cast<int>((x * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+// Bitset over the guessable numbers, bit v stands for the value v
+class CandidateSet {
+public:
+    static const int WORDS = 16;
+    static const int MAX_VALUE = WORDS * 64 - 1;
+
+    // Values lo..hi inclusive, clipped to the representable range
+    static CandidateSet interval(int lo, int hi) {
+        CandidateSet set;
+        lo = std::max(lo, 0);
+        hi = std::min(hi, MAX_VALUE);
+        for (int w = 0; w < WORDS && lo <= hi; ++w) {
+            int first = std::max(lo, w * 64) - w * 64;
+            int last = std::min(hi, w * 64 + 63) - w * 64;
+            if (first > last) continue;
+            std::uint64_t upper = last == 63 ? ~0ull : (1ull << (last + 1)) - 1;
+            set.words[w] = upper & (~0ull << first);
+        }
+        return set;
+    }
+
+    // Every value with value % 2 == remainder
+    static CandidateSet parity(int remainder) {
+        CandidateSet set;
+        set.words.fill(remainder == 0 ? 0x5555555555555555ull : 0xAAAAAAAAAAAAAAAAull);
+        return set;
+    }
+
+    void intersect(const CandidateSet& other) {
+        for (int w = 0; w < WORDS; ++w) words[w] &= other.words[w];
+    }
+
+    void unite(const CandidateSet& other) {
+        for (int w = 0; w < WORDS; ++w) words[w] |= other.words[w];
+    }
+
+    bool test(int value) const {
+        return value >= 0 && value <= MAX_VALUE && ((words[value / 64] >> (value % 64)) & 1) != 0;
+    }
+
+    int count() const {
+        int total = 0;
+        for (auto word : words) total += popcount64(word);
+        return total;
+    }
+
+private:
+    std::array<std::uint64_t, WORDS> words{};
+};
+
+struct GuessClue {
+    int value;
+    bool parityHint;        // Odd/Even Hint was active
+    bool directionHint;     // Hint Helper (higher/lower) was active
+};
+
+struct GuessAnalysis {
+    int guess = 0;
+    int candidatesBefore = 0;
+    int candidatesAfter = 0;
+    float bitsGained = 0.f;
+    float bestBits = 0.f;   // expected information of the best guess at that point
+    int bestGuess = 0;
+};
+
+// Replays a finished game and measures how far each guess narrowed down the
+// secret, compared with the most informative guess available at that point.
+// Candidates are a bitset; per-parity prefix counts over it make every
+// "how many candidates in this band" question O(1), so scoring all possible
+// guesses costs range * bands lookups per turn.
+class GameAnalyzer {
+public:
+    GameAnalyzer(int range, int secret) : range(std::min(range, CandidateSet::MAX_VALUE)), secret(secret) {
+        // Bands grow with distance, so each one covers a contiguous distance span
+        for (int b = 0; b < TEMPERATURE_BANDS; ++b) {
+            bandMin[b] = this->range + 1;
+            bandMax[b] = 0;
+        }
+        for (int d = 1; d <= this->range; ++d) {
+            int b = temperatureBand(d, this->range);
+            bandMin[b] = std::min(bandMin[b], d);
+            bandMax[b] = std::max(bandMax[b], d);
+        }
+    }
+
+    std::vector<GuessAnalysis> analyze(const std::vector<GuessClue>& clues) {
+        std::vector<GuessAnalysis> result;
+        result.reserve(clues.size());
+
+        CandidateSet candidates = CandidateSet::interval(1, range);
+        for (const auto& clue : clues) {
+            GuessAnalysis entry;
+            entry.guess = clue.value;
+            entry.candidatesBefore = candidates.count();
+
+            buildPrefixCounts(candidates);
+            entry.bestBits = -1.f;
+            for (int x = 1; x <= range; ++x) {
+                float bits = expectedBits(x, candidates.test(x), entry.candidatesBefore, clue);
+                if (bits > entry.bestBits) {
+                    entry.bestBits = bits;
+                    entry.bestGuess = x;
+                }
+            }
+
+            candidates.intersect(consistentWith(clue));
+            entry.candidatesAfter = candidates.count();
+            entry.bitsGained = entry.candidatesAfter > 0 ?
+                static_cast<float>(std::log2(static_cast<double>(entry.candidatesBefore) / entry.candidatesAfter)) : 0.f;
+            result.push_back(entry);
         }
+        return result;
     }
 
-    void save() {
-        std::ofstream file(CONFIG_FILE);
+private:
+    // Every secret that would have produced the same feedback as the real one
+    CandidateSet consistentWith(const GuessClue& clue) const {
+        int g = clue.value;
+        if (g == secret) return CandidateSet::interval(g, g);
+
+        int b = temperatureBand(std::abs(g - secret), range);
+        CandidateSet below = CandidateSet::interval(g - bandMax[b], g - bandMin[b]);
+        CandidateSet above = CandidateSet::interval(g + bandMin[b], g + bandMax[b]);
+        CandidateSet result;
+        if (!clue.directionHint || secret < g) result.unite(below);
+        if (!clue.directionHint || secret > g) result.unite(above);
+        if (clue.parityHint) result.intersect(CandidateSet::parity(secret % 2));
+        return result;
+    }
+
+    void buildPrefixCounts(const CandidateSet& candidates) {
+        prefix[0][0] = prefix[1][0] = 0;
+        for (int v = 1; v <= range; ++v) {
+            prefix[0][v] = prefix[0][v - 1];
+            prefix[1][v] = prefix[1][v - 1];
+            if (candidates.test(v)) ++prefix[v % 2][v];
+        }
+    }
+
+    // Candidates in lo..hi, of one parity or of both when parity is -1
+    int countIn(int lo, int hi, int parity) const {
+        lo = std::max(lo, 1);
+        hi = std::min(hi, range);
+        if (lo > hi) return 0;
+        int even = prefix[0][hi] - prefix[0][lo - 1];
+        int odd = prefix[1][hi] - prefix[1][lo - 1];
+        return parity < 0 ? even + odd : (parity == 0 ? even : odd);
+    }
+
+    // Entropy of the feedback for guessing x, with every candidate equally likely
+    float expectedBits(int x, bool xIsCandidate, int total, const GuessClue& clue) const {
+        if (total <= 1) return 0.f;
+        double bits = 0.0;
+        auto outcome = [&](int count) {
+            if (count > 0) bits += count * std::log2(static_cast<double>(total) / count);
+        };
+
+        if (xIsCandidate) outcome(1);
+        for (int b = 0; b < TEMPERATURE_BANDS; ++b) {
+            if (bandMin[b] > bandMax[b]) continue;
+            for (int p = clue.parityHint ? 0 : -1; p <= (clue.parityHint ? 1 : -1); ++p) {
+                int below = countIn(x - bandMax[b], x - bandMin[b], p);
+                int above = countIn(x + bandMin[b], x + bandMax[b], p);
+                if (clue.directionHint) {
+                    outcome(below);
+                    outcome(above);
+                }
+                else {
+                    outcome(below + above);
+                }
+            }
+        }
+        return static_cast<float>(bits / total);
+    }
+
+    int range;
+    int secret;
+    std::array<int, TEMPERATURE_BANDS> bandMin;
+    std::array<int, TEMPERATURE_BANDS> bandMax;
+    std::array<std::array<int, CandidateSet::MAX_VALUE + 1>, 2> prefix;
+};
+
+// Rules shared by the windowed game and the terminal front-end. Achievement
+// and shop indices follow the save file.
+const char* const TEMPERATURE_HINTS[TEMPERATURE_BANDS] = {
+    "BOILING HOT!", "Very Hot", "Hot", "Warm", "Cool", "Cold", "FREEZING!"
+};
+
+struct CatalogEntry {
+    const char* title;
+    const char* description;
+    int cost;
+};
+
+const int ACHIEVEMENT_COUNT = 12;
+const CatalogEntry ACHIEVEMENT_INFO[ACHIEVEMENT_COUNT] = {
+    { "Beginner", "Complete first game", 0 },
+    { "Pro", "Win in 5 tries", 0 },
+    { "Legend", "Win on first try", 0 },
+    { "Time Master", "Win on Expert/Master with time left", 0 },
+    { "Perfect Guess", "Win on Master difficulty", 0 },
+    { "Hot Streak", "Win 3 games in a row", 0 },
+    { "Number Ninja", "Win on all difficulty levels", 0 },
+    { "Persistent", "Make 10 wrong guesses in one game", 0 },
+    { "Close Call", "Win with last attempt", 0 },
+    { "Speed Demon", "Win in under 30 seconds", 0 },
+    { "Cold Blooded", "Win with freezing guess", 0 },
+    { "Completionist", "Unlock all achievements", 0 }
+};
+const int FREEZING_ACHIEVEMENT = 10;
+const int COMPLETIONIST_ACHIEVEMENT = 11;
+
+enum ShopPerk { HINT_HELPER, RANGE_REVEALER, EXTRA_ATTEMPT, TIME_EXTENDER, ODD_EVEN_HINT, SHOP_ITEM_COUNT };
+const CatalogEntry SHOP_ITEM_INFO[SHOP_ITEM_COUNT] = {
+    { "Hint Helper", "Shows hint after wrong guess", 100 },
+    { "Range Revealer", "Shows range after 3 attempts", 200 },
+    { "Extra Attempt", "+1 attempt in each game", 300 },
+    { "Time Extender", "+30 sec in timed modes", 400 },
+    { "Odd/Even Hint", "Shows if number is odd/even", 150 }
+};
+
+inline std::string parityHint(int secret) {
+    return std::string(" (") + (secret % 2 == 0 ? "Even" : "Odd") + ")";
+}
+
+inline std::string directionHint(int guess, int secret) {
+    return std::string(" (") + (guess < secret ? "Higher" : "Lower") + ")";
+}
+
+inline std::string revealedRange(int secret, int range) {
+    int lower = std::max(1, secret - range / 10);
+    int upper = std::min(range, secret + range / 10);
+    return "Range: " + std::to_string(lower) + "-" + std::to_string(upper);
+}
+
+// What a won game is judged on
+struct WonGame {
+    int difficulty;
+    int attempts;
+    int maxAttempts;
+    bool timed;
+    bool timeLeft;
+    float secondsPlayed;
+};
+
+// Achievements a win earns, checked in the order the game always has.
+// Completionist is checked separately once these are unlocked.
+inline std::vector<int> winAchievements(const WonGame& game) {
+    std::vector<int> earned;
+    if (game.attempts == 1) earned.push_back(2);
+    if (game.attempts <= 5) earned.push_back(1);
+    earned.push_back(0);
+    if (game.attempts >= 10) earned.push_back(7);
+    if (game.maxAttempts > 0 && game.attempts == game.maxAttempts - 1) earned.push_back(8);
+
+    if (game.timed && game.difficulty >= 3 && game.timeLeft) earned.push_back(3);
+    if (game.difficulty == 4) earned.push_back(4);
+    if (game.timed && game.secondsPlayed < 30.f) earned.push_back(9);
+
+    bool allDifficulties = true;
+    for (int i = 0; i < DIFFICULTY_COUNT; ++i) {
+        allDifficulties = allDifficulties && (i == game.difficulty);
+    }
+    if (allDifficulties) earned.push_back(6);
+    return earned;
+}
+
+template <typename IsUnlocked>
+bool completionistEarned(IsUnlocked isUnlocked) {
+    for (int i = 0; i < ACHIEVEMENT_COUNT; ++i) {
+        if (i != COMPLETIONIST_ACHIEVEMENT && !isUnlocked(i)) return false;
+    }
+    return true;
+}
+
+// Player progress in the save file format
+struct SaveData {
+    int bestScore = 999;
+    int totalPoints = 0;
+    std::array<bool, ACHIEVEMENT_COUNT> achievements{};
+    std::array<bool, SHOP_ITEM_COUNT> purchased{};
+    std::array<bool, SHOP_ITEM_COUNT> active{};
+
+    bool load(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) return false;
+        file >> bestScore;
+        file >> totalPoints;
+        for (auto& unlocked : achievements) {
+            bool value;
+            if (file >> value) unlocked = value;
+        }
+        for (int i = 0; i < SHOP_ITEM_COUNT; ++i) {
+            bool isPurchased, isActive;
+            if (file >> isPurchased >> isActive) {
+                purchased[i] = isPurchased;
+                active[i] = isActive;
+            }
+        }
+        return true;
+    }
+
+    void save(const std::string& path) const {
+        std::ofstream file(path);
         if (file) {
-            file << width << " " << height << " " << fullscreen;
+            file << bestScore << "\n";
+            file << totalPoints << "\n";
+            for (bool unlocked : achievements) {
+                file << unlocked << " ";
+            }
+            file << "\n";
+            for (int i = 0; i < SHOP_ITEM_COUNT; ++i) {
+                file << purchased[i] << " " << active[i] << " ";
+            }
         }
     }
 };
 
-class ResourceManager {
+// CRC-32 (IEEE), for records that a crash may have left half written
+inline std::uint32_t crc32(const char* data, std::size_t size) {
+    static const std::array<std::uint32_t, 256> table = [] {
+        std::array<std::uint32_t, 256> entries{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[i] = c;
+        }
+        return entries;
+    }();
+    std::uint32_t crc = 0xFFFFFFFFu;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Every player profile in one file: a header, an index of profile names and
+// a table of fixed-size records in the same order, so the record of index
+// slot i sits at a computed offset. Opening reads the header and the names
+// only; loading a profile seeks straight to its one record. The index has
+// room for `capacity` names and is rewritten at twice the size when it
+// fills up. Numbers are stored little-endian.
+//
+// Saving never rewrites a record in place. The fields that changed are
+// appended to a journal as checksummed delta records, and the profiles they
+// touch are kept in memory, so a save costs the same however much progress
+// there is and a crash can only cut off the journal's last delta. Once the
+// journal passes JOURNAL_LIMIT it is set aside as .old and a background
+// thread folds those profiles into the records; a record half written by a
+// crash is repaired at the next open, which replays .old and the journal
+// over the records before starting an empty journal.
+class ProfileStore {
 public:
-    static sf::Font& getFont() {
-        static sf::Font font;
-        if (!font.loadFromFile(RESOURCES_DIR + "videotype.otf")) {
-            throw std::runtime_error("Failed to load font!");
+    static const std::size_t NAME_SIZE = 32;        // NUL-padded, so names keep at most 31 bytes
+    static const std::size_t HEADER_SIZE = 24;      // magic, record size, capacity, count, current slot
+    static const std::size_t RECORD_SIZE = 8 + ACHIEVEMENT_COUNT + 2 * SHOP_ITEM_COUNT;
+    static const std::uint32_t INITIAL_CAPACITY = 1024;
+    static const std::size_t DELTA_SIZE = 16;       // slot, type, index, value, CRC-32 of the first 12 bytes
+    static const std::size_t JOURNAL_LIMIT = 64 * 1024;
+
+    ProfileStore() = default;
+    ProfileStore(const ProfileStore&) = delete;
+    ProfileStore& operator=(const ProfileStore&) = delete;
+
+    ~ProfileStore() {
+        if (compactor.joinable()) compactor.join();
+    }
+
+    // Creates the file if it is missing. A file in another format is moved
+    // aside to path + ".bad" and replaced by an empty store.
+    bool open(const std::string& path) {
+        if (compactor.joinable()) compactor.join();
+        this->path = path;
+        names.clear();
+        slots.clear();
+        file.close();
+        file.clear();
+        file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+        if (!file) return create(INITIAL_CAPACITY);
+
+        char header[HEADER_SIZE];
+        if (!file.read(header, HEADER_SIZE) || std::memcmp(header, MAGIC, 8) != 0 || get32(header + 8) != RECORD_SIZE) {
+            std::cerr << "Warning: " << path << " is not a profile store, moving it to " << path << ".bad" << std::endl;
+            file.close();
+            std::remove((path + ".bad").c_str());
+            std::rename(path.c_str(), (path + ".bad").c_str());
+            return create(INITIAL_CAPACITY);
         }
-        return font;
+        capacity = get32(header + 12);
+        std::uint32_t count = std::min(get32(header + 16), capacity);
+        currentSlot = static_cast<int>(get32(header + 20));
+
+        std::vector<char> index(static_cast<std::size_t>(count) * NAME_SIZE);
+        if (count > 0 && !file.read(index.data(), index.size())) return false;
+        names.reserve(count);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            const char* entry = index.data() + static_cast<std::size_t>(i) * NAME_SIZE;
+            names.emplace_back(entry, strnlen(entry, NAME_SIZE));
+            slots[names.back()] = static_cast<int>(i);
+        }
+        if (currentSlot >= static_cast<int>(count)) currentSlot = -1;
+        return openJournal();
     }
 
-    static sf::Texture& getButtonTexture() {
-        static sf::Texture texture;
-        if (!texture.loadFromFile(RESOURCES_DIR + "knopka.png")) {
-            throw std::runtime_error("Failed to load button texture!");
+    bool isOpen() const { return file.is_open(); }
+    std::size_t size() const { return names.size(); }
+    const std::string& name(int slot) const { return names[slot]; }
+    int current() const { return currentSlot; }
+
+    int find(const std::string& name) const {
+        auto it = slots.find(name.substr(0, NAME_SIZE - 1));
+        return it == slots.end() ? -1 : it->second;
+    }
+
+    // Slot of the named profile, created with the given progress if new; -1 on error
+    int select(const std::string& name, const SaveData& initial = SaveData()) {
+        if (name.empty() || !isOpen()) return -1;
+        std::lock_guard<std::mutex> lock(mutex);
+        int slot = find(name);
+        if (slot < 0) {
+            if (names.size() == capacity && !grow()) return -1;
+            slot = static_cast<int>(names.size());
+            std::string key = name.substr(0, NAME_SIZE - 1);
+            char entry[NAME_SIZE] = {};
+            std::memcpy(entry, key.data(), key.size());
+            char record[RECORD_SIZE];
+            encode(initial, record);
+
+            // The record and its name go in before the count that makes them visible
+            file.seekp(recordOffset(slot));
+            file.write(record, RECORD_SIZE);
+            file.seekp(HEADER_SIZE + static_cast<std::streamoff>(slot) * NAME_SIZE);
+            file.write(entry, NAME_SIZE);
+            if (!writeHeaderField(16, static_cast<std::uint32_t>(slot + 1))) return -1;
+            names.push_back(key);
+            slots[key] = slot;
         }
-        return texture;
+        if (slot != currentSlot) {
+            writeHeaderField(20, static_cast<std::uint32_t>(slot));
+            currentSlot = slot;
+        }
+        return slot;
     }
 
-    static sf::SoundBuffer& getClickSound() {
-        static sf::SoundBuffer buffer;
-        if (!buffer.loadFromFile(RESOURCES_DIR + "mixkit-arcade-game-jump-coin-216.wav")) {
-            throw std::runtime_error("Failed to load click sound!");
+    bool read(int slot, SaveData& data) {
+        if (slot < 0 || slot >= static_cast<int>(names.size())) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = pending.find(slot);
+        if (it != pending.end()) {
+            data = it->second;
+            return true;
         }
-        return buffer;
+        it = folding.find(slot);
+        if (it != folding.end()) {
+            data = it->second;
+            return true;
+        }
+        return readRecord(slot, data);
     }
 
-    static sf::SoundBuffer& getWinSound() {
-        static sf::SoundBuffer buffer;
-        if (!buffer.loadFromFile(RESOURCES_DIR + "9f2836f2b6a3690.mp3")) {
-            throw std::runtime_error("Failed to load win sound!");
+    // Journals the fields that differ from the profile's last saved state
+    bool write(int slot, const SaveData& data) {
+        if (slot < 0 || slot >= static_cast<int>(names.size())) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        SaveData& saved = latest(slot);
+        if (data.bestScore != saved.bestScore) appendDelta(slot, BEST_SCORE, 0, data.bestScore);
+        if (data.totalPoints != saved.totalPoints) appendDelta(slot, TOTAL_POINTS, 0, data.totalPoints);
+        for (int i = 0; i < ACHIEVEMENT_COUNT; ++i) {
+            if (data.achievements[i] != saved.achievements[i]) appendDelta(slot, ACHIEVEMENT, i, data.achievements[i]);
         }
-        return buffer;
+        for (int i = 0; i < SHOP_ITEM_COUNT; ++i) {
+            if (data.purchased[i] != saved.purchased[i]) appendDelta(slot, PURCHASED, i, data.purchased[i]);
+            if (data.active[i] != saved.active[i]) appendDelta(slot, ACTIVE, i, data.active[i]);
+        }
+        saved = data;
+        journal.flush();
+        if (journalBytes >= JOURNAL_LIMIT && !compacting) startCompaction();
+        return static_cast<bool>(journal);
     }
 
-    static sf::SoundBuffer& getLoseSound() {
-        static sf::SoundBuffer buffer;
-        if (!buffer.loadFromFile(RESOURCES_DIR + "e285e54b799801b.mp3")) {
-            throw std::runtime_error("Failed to load lose sound!");
+    std::size_t journalSize() const { return journalBytes; }
+
+private:
+    enum DeltaType { BEST_SCORE, TOTAL_POINTS, ACHIEVEMENT, PURCHASED, ACTIVE };
+
+    static constexpr const char* MAGIC = "SNPROF01";
+
+    std::streamoff recordOffset(int slot) const {
+        return HEADER_SIZE + static_cast<std::streamoff>(capacity) * NAME_SIZE + static_cast<std::streamoff>(slot) * RECORD_SIZE;
+    }
+
+    bool create(std::uint32_t newCapacity) {
+        file.close();
+        file.clear();
+        file.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        capacity = newCapacity;
+        currentSlot = -1;
+        char header[HEADER_SIZE];
+        std::memcpy(header, MAGIC, 8);
+        put32(header + 8, static_cast<std::uint32_t>(RECORD_SIZE));
+        put32(header + 12, capacity);
+        put32(header + 16, 0);
+        put32(header + 20, 0xFFFFFFFFu);
+        file.write(header, HEADER_SIZE);
+        file.flush();
+        return file && openJournal();
+    }
+
+    // Folds what the last run journaled into the records, then starts an
+    // empty journal. Deltas for slots the index does not hold are dropped.
+    bool openJournal() {
+        journalPath = path + ".journal";
+        pending.clear();
+        folding.clear();
+        replay(journalPath + ".old");
+        replay(journalPath);
+        for (const auto& entry : pending) writeRecord(entry.first, entry.second);
+        file.flush();
+        if (!file) return false;
+        pending.clear();
+        foldFailed = false;
+
+        journal.close();
+        journal.clear();
+        journal.open(journalPath, std::ios::binary | std::ios::trunc);
+        std::remove((journalPath + ".old").c_str());
+        journalBytes = 0;
+        return static_cast<bool>(journal);
+    }
+
+    // Stops at the first delta whose checksum fails: the torn tail of an append
+    void replay(const std::string& journalFile) {
+        std::ifstream in(journalFile, std::ios::binary);
+        char delta[DELTA_SIZE];
+        while (in.read(delta, DELTA_SIZE)) {
+            if (get32(delta + 12) != crc32(delta, 12)) break;
+            std::uint32_t slot = get32(delta);
+            if (slot >= names.size()) continue;
+            SaveData& data = latest(static_cast<int>(slot));
+            int index = static_cast<unsigned char>(delta[5]);
+            int value = static_cast<int>(get32(delta + 8));
+            switch (delta[4]) {
+            case BEST_SCORE: data.bestScore = value; break;
+            case TOTAL_POINTS: data.totalPoints = value; break;
+            case ACHIEVEMENT: if (index < ACHIEVEMENT_COUNT) data.achievements[index] = value != 0; break;
+            case PURCHASED: if (index < SHOP_ITEM_COUNT) data.purchased[index] = value != 0; break;
+            case ACTIVE: if (index < SHOP_ITEM_COUNT) data.active[index] = value != 0; break;
+            }
         }
-        return buffer;
     }
 
-    static sf::Texture& getBackgroundTexture() {
-        static sf::Texture texture;
-        if (!texture.loadFromFile(RESOURCES_DIR + "background1.jpg")) {
-            throw std::runtime_error("Failed to load background texture!");
+    // The profile's state as last saved, kept in pending until it is folded
+    SaveData& latest(int slot) {
+        auto it = pending.find(slot);
+        if (it != pending.end()) return it->second;
+        SaveData data;
+        auto folded = folding.find(slot);
+        if (folded != folding.end()) data = folded->second;
+        else readRecord(slot, data);
+        return pending.emplace(slot, data).first->second;
+    }
+
+    void appendDelta(int slot, DeltaType type, int index, int value) {
+        char delta[DELTA_SIZE];
+        put32(delta, static_cast<std::uint32_t>(slot));
+        delta[4] = static_cast<char>(type);
+        delta[5] = static_cast<char>(index);
+        delta[6] = delta[7] = 0;
+        put32(delta + 8, static_cast<std::uint32_t>(value));
+        put32(delta + 12, crc32(delta, 12));
+        journal.write(delta, DELTA_SIZE);
+        journalBytes += DELTA_SIZE;
+    }
+
+    // Called with the lock held. The previous compactor has cleared
+    // `compacting` as its last step, so joining it never waits on the lock.
+    // After a failed fold .old is kept for the next open and the journal
+    // just keeps growing.
+    void startCompaction() {
+        if (compactor.joinable()) compactor.join();
+        if (foldFailed) return;
+        journal.close();
+        std::rename(journalPath.c_str(), (journalPath + ".old").c_str());
+        journal.clear();
+        journal.open(journalPath, std::ios::binary | std::ios::trunc);
+        journalBytes = 0;
+        folding = std::move(pending);
+        pending.clear();
+        compacting = true;
+        compactor = std::thread(&ProfileStore::compact, this);
+    }
+
+    // Background thread. Only reads `folding`, which the owner leaves alone
+    // until the next compaction, and takes the lock per record, so saves and
+    // profile switches wait for one record write at most.
+    void compact() {
+        for (const auto& entry : folding) {
+            std::lock_guard<std::mutex> lock(mutex);
+            writeRecord(entry.first, entry.second);
         }
-        return texture;
+        bool written;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            file.flush();
+            written = static_cast<bool>(file);
+        }
+        // A failed fold keeps .old, to be replayed at the next open
+        if (written) std::remove((journalPath + ".old").c_str());
+        else foldFailed = true;
+        compacting = false;
     }
 
-    static sf::Texture& getShopItemTexture() {
-        static sf::Texture texture;
-        if (!texture.loadFromFile(RESOURCES_DIR + "knopka.png")) {
-            throw std::runtime_error("Failed to load shop item texture!");
+    bool readRecord(int slot, SaveData& data) {
+        char record[RECORD_SIZE];
+        file.clear();
+        file.seekg(recordOffset(slot));
+        if (!file.read(record, RECORD_SIZE)) return false;
+        decode(record, data);
+        return true;
+    }
+
+    void writeRecord(int slot, const SaveData& data) {
+        char record[RECORD_SIZE];
+        encode(data, record);
+        file.clear();
+        file.seekp(recordOffset(slot));
+        file.write(record, RECORD_SIZE);
+    }
+
+    // Rewrites the store with twice the index room through a temporary file,
+    // so a failure leaves the old store in place
+    bool grow() {
+        std::vector<char> records(names.size() * RECORD_SIZE);
+        file.clear();
+        file.seekg(recordOffset(0));
+        if (!records.empty() && !file.read(records.data(), records.size())) return false;
+
+        std::uint32_t newCapacity = capacity * 2;
+        std::ofstream out(path + ".tmp", std::ios::binary | std::ios::trunc);
+        char header[HEADER_SIZE];
+        std::memcpy(header, MAGIC, 8);
+        put32(header + 8, static_cast<std::uint32_t>(RECORD_SIZE));
+        put32(header + 12, newCapacity);
+        put32(header + 16, static_cast<std::uint32_t>(names.size()));
+        put32(header + 20, currentSlot < 0 ? 0xFFFFFFFFu : static_cast<std::uint32_t>(currentSlot));
+        out.write(header, HEADER_SIZE);
+        std::vector<char> index(static_cast<std::size_t>(newCapacity) * NAME_SIZE, '\0');
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            std::memcpy(index.data() + i * NAME_SIZE, names[i].data(), names[i].size());
         }
-        return texture;
+        out.write(index.data(), index.size());
+        out.write(records.data(), records.size());
+        out.close();
+        if (!out) return false;
+
+        file.close();
+        std::remove(path.c_str());
+        if (std::rename((path + ".tmp").c_str(), path.c_str()) != 0) return false;
+        file.clear();
+        file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+        capacity = newCapacity;
+        return static_cast<bool>(file);
+    }
+
+    bool writeHeaderField(std::streamoff offset, std::uint32_t value) {
+        char bytes[4];
+        put32(bytes, value);
+        file.clear();
+        file.seekp(offset);
+        file.write(bytes, 4);
+        file.flush();
+        return static_cast<bool>(file);
+    }
+
+    static void encode(const SaveData& data, char* record) {
+        put32(record, static_cast<std::uint32_t>(data.bestScore));
+        put32(record + 4, static_cast<std::uint32_t>(data.totalPoints));
+        char* flags = record + 8;
+        for (bool unlocked : data.achievements) *flags++ = unlocked;
+        for (int i = 0; i < SHOP_ITEM_COUNT; ++i) {
+            *flags++ = data.purchased[i];
+            *flags++ = data.active[i];
+        }
+    }
+
+    static void decode(const char* record, SaveData& data) {
+        data.bestScore = static_cast<int>(get32(record));
+        data.totalPoints = static_cast<int>(get32(record + 4));
+        const char* flags = record + 8;
+        for (auto& unlocked : data.achievements) unlocked = *flags++ != 0;
+        for (int i = 0; i < SHOP_ITEM_COUNT; ++i) {
+            data.purchased[i] = *flags++ != 0;
+            data.active[i] = *flags++ != 0;
+        }
+    }
+
+    static void put32(char* out, std::uint32_t value) {
+        for (int i = 0; i < 4; ++i) out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+
+    static std::uint32_t get32(const char* in) {
+        std::uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) value |= static_cast<std::uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+        return value;
     }
+
+    std::string path;
+    std::fstream file;
+    std::uint32_t capacity = 0;
+    int currentSlot = -1;
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int> slots;
+
+    // Guards `file` between the owner and the compactor
+    std::mutex mutex;
+    std::string journalPath;
+    std::ofstream journal;
+    std::size_t journalBytes = 0;
+    std::unordered_map<int, SaveData> pending;   // saved since the journal was started
+    std::unordered_map<int, SaveData> folding;   // from .old, being written into the records
+    std::atomic<bool> compacting{ false };
+    std::atomic<bool> foldFailed{ false };
+    std::thread compactor;
 };
 
-class Button {
+// Opens the profile store and selects the requested profile, or the one used
+// last. A new store takes over the single-player save file as DEFAULT_PROFILE.
+// Returns the selected slot, -1 when progress cannot be kept.
+int openProfiles(ProfileStore& profiles, const std::string& requested) {
+    if (!profiles.open(PROFILES_FILE)) {
+        std::cerr << "Error: Failed to open " << PROFILES_FILE << ", progress will not be saved" << std::endl;
+        return -1;
+    }
+    if (profiles.size() == 0) {
+        SaveData legacy;
+        legacy.load(SAVE_FILE);
+        profiles.select(DEFAULT_PROFILE, legacy);
+    }
+    if (!requested.empty()) return profiles.select(requested);
+    return profiles.select(profiles.current() >= 0 ? profiles.name(profiles.current()) : DEFAULT_PROFILE);
+}
+
+// Plays the same rules over stdin/stdout, one command per line, without
+// touching the window, audio or any graphics resource
+class TerminalGame {
 public:
-    Button(const std::string& text, sf::Vector2f pos, std::function<void()> action, int zIndex = 0,
-        float width = 200.f, float height = 50.f, int fontSize = 24)
-        : action(std::move(action)), originalPosition(pos), targetPosition(pos), zIndex(zIndex),
-        width(width), height(height), fontSize(fontSize) {
-        shape.setSize({ width, height });
-        shape.setPosition(pos);
-        shape.setTexture(&ResourceManager::getButtonTexture());
-        shape.setOutlineThickness(2.f);
-        shape.setOutlineColor(sf::Color::Transparent);
-
-        label.setFont(ResourceManager::getFont());
-        label.setString(text);
-        label.setCharacterSize(fontSize);
-        label.setFillColor(sf::Color::White);
-        updateTextPosition();
-
-        visible = true;
-        clickProcessed = false;
-        wasPressed = false;
-        hoverEffectActive = true;
-    }
-
-    void setVisible(bool isVisible) {
-        visible = isVisible;
-        if (!visible) {
-            clickProcessed = false;
-            wasPressed = false;
-            isHovered = false;
-        }
-    }
-    bool isVisible() const { return visible; }
-    int getZIndex() const { return zIndex; }
-    bool wasPressedThisFrame() const { return wasPressed; }
-    void resetPressState() { wasPressed = false; }
-    void setHoverEffect(bool active) { hoverEffectActive = active; }
-    sf::Vector2f getOriginalPosition() const { return originalPosition; }
-    void setOriginalPosition(sf::Vector2f pos) { originalPosition = pos; }
-    void setSize(float w, float h) {
-        width = w;
-        height = h;
-        shape.setSize({ width, height });
-        updateTextPosition();
-    }
-
-    void update(const sf::RenderWindow& window, sf::Time deltaTime, bool& buttonPressedThisFrame, bool allowInteraction) {
-        if (!visible || !allowInteraction) {
-            clickProcessed = false;
-            wasPressed = false;
-            isHovered = false;
+    explicit TerminalGame(unsigned seed) : rng(seed) {
+        profileSlot = openProfiles(profiles, "");
+        profiles.read(profileSlot, progress);
+    }
+
+    int run(std::istream& in, std::ostream& out) {
+        out << "Shaolin Number (terminal). Type 'help' for commands.\n";
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream words(line);
+            std::string command;
+            if (!(words >> command)) continue;
+            std::transform(command.begin(), command.end(), command.begin(),
+                [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+            if (command == "quit" || command == "exit") break;
+            else if (command == "help") printHelp(out);
+            else if (command == "new") startGame(out);
+            else if (command == "shop") printShop(out);
+            else if (command == "buy") {
+                int index = 0;
+                if (words >> index) purchase(index - 1, out);
+                else out << "Usage: buy <item number>\n";
+            }
+            else if (command == "achievements") printAchievements(out);
+            else if (command == "stats") {
+                out << "Points: " << progress.totalPoints << ", best score: " << progress.bestScore << "\n";
+            }
+            else if (command == "profile") {
+                std::string name;
+                if (words >> name) switchProfile(name, out);
+                else out << "Profile: " << (profileSlot >= 0 ? profiles.name(profileSlot) : "(none)")
+                    << " of " << profiles.size() << "\n";
+            }
+            else if (!selectDifficulty(command, out)) {
+                char* end = nullptr;
+                long guess = std::strtol(command.c_str(), &end, 10);
+                if (end && *end == '\0') processGuess(static_cast<int>(guess), out);
+                else out << "Unknown command: " << command << "\n";
+            }
+        }
+        out.flush();
+        return EXIT_SUCCESS;
+    }
+
+private:
+    void printHelp(std::ostream& out) const {
+        out << "easy|medium|hard|expert|master  choose difficulty\n"
+            << "new                               start a game\n"
+            << "<number>                          guess\n"
+            << "shop, buy <n>                     list, buy or toggle shop items\n"
+            << "profile [name]                    show or switch the player profile\n"
+            << "achievements, stats, quit\n";
+    }
+
+    bool selectDifficulty(const std::string& name, std::ostream& out) {
+        for (int i = 0; i < DIFFICULTY_COUNT; ++i) {
+            std::string candidate = DIFFICULTY_RULES[i].name;
+            std::transform(candidate.begin(), candidate.end(), candidate.begin(),
+                [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (candidate == name) {
+                difficulty = i;
+                out << "Difficulty: " << DIFFICULTY_RULES[i].name << "\n";
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool perk(ShopPerk item) const { return progress.active[item]; }
+
+    void startGame(std::ostream& out) {
+        const DifficultyRules& rules = DIFFICULTY_RULES[difficulty];
+        range = rules.range;
+        maxAttempts = rules.maxAttempts;
+        timeLimit = rules.timeLimitSeconds;
+        if (perk(EXTRA_ATTEMPT) && maxAttempts > 0) maxAttempts++;
+        if (perk(TIME_EXTENDER) && timeLimit > 0) timeLimit += 30;
+
+        secretNumber = std::uniform_int_distribution<int>(1, range)(rng);
+        attempts = 0;
+        playing = true;
+        startTime = std::chrono::steady_clock::now();
+
+        out << "New game: " << rules.name << " (1-" << range << ")";
+        if (maxAttempts > 0) out << ", " << maxAttempts << " attempts";
+        if (timeLimit > 0) out << ", " << timeLimit << " s";
+        out << "\n";
+    }
+
+    float secondsPlayed() const {
+        return std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+    }
+
+    void processGuess(int guess, std::ostream& out) {
+        if (!playing) {
+            out << "No game in progress, type 'new'\n";
+            return;
+        }
+        if (timeLimit > 0 && secondsPlayed() >= timeLimit) {
+            endGame(false, out);
+            return;
+        }
+        if (guess < 1 || guess > range) {
+            out << "Out of range (1-" << range << ")\n";
             return;
         }
 
-        wasPressed = false;
+        attempts++;
+        GuessOutcome outcome = evaluateGuess(difficulty, guess, secretNumber);
+        int band = outcome.band;
+        if (band == TEMPERATURE_BANDS - 1) unlock(FREEZING_ACHIEVEMENT, out);
 
-        isHovered = shape.getGlobalBounds().contains(
-            static_cast<float>(sf::Mouse::getPosition(window).x),
-            static_cast<float>(sf::Mouse::getPosition(window).y)
-        );
+        if (outcome.correct) {
+            endGame(true, out);
+            return;
+        }
 
-        if (hoverEffectActive) {
-            targetPosition = originalPosition + (isHovered ? sf::Vector2f(0, -10.f) : sf::Vector2f(0, 0));
-            sf::Vector2f currentPos = shape.getPosition();
-            sf::Vector2f newPos = currentPos + (targetPosition - currentPos) * 10.f * deltaTime.asSeconds();
-            shape.setPosition(newPos);
+        std::string hint = TEMPERATURE_HINTS[band];
+        if (perk(ODD_EVEN_HINT)) hint += parityHint(secretNumber);
+        if (perk(HINT_HELPER)) hint += directionHint(guess, secretNumber);
+        out << guess << ": " << hint << "\n";
 
-            shape.setFillColor(isHovered ?
-                sf::Color(255, 255, 255, 180) :
-                sf::Color(255, 255, 255, 140));
+        if (maxAttempts > 0 && attempts >= maxAttempts) {
+            endGame(false, out);
+        }
+        else if (perk(RANGE_REVEALER) && attempts >= 3) {
+            out << revealedRange(secretNumber, range) << "\n";
+        }
+    }
 
-            shape.setOutlineColor(isHovered ?
-                sf::Color(255, 215, 0, 255) :
-                sf::Color::Transparent);
+    void endGame(bool won, std::ostream& out) {
+        playing = false;
+        if (!won) {
+            out << "LOSE: " << (maxAttempts > 0 && attempts >= maxAttempts ? "out of attempts" : "time's up")
+                << ", the number was " << secretNumber << "\n";
+            saveProgress();
+            return;
         }
 
-        updateTextPosition();
+        float played = secondsPlayed();
+        progress.totalPoints += DIFFICULTY_RULES[difficulty].points;
+        if (attempts < progress.bestScore) progress.bestScore = attempts;
+        out << "WIN in " << attempts << " attempts, +" << DIFFICULTY_RULES[difficulty].points << " points\n";
 
-        if (isHovered && sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
-            if (!clickProcessed && !buttonPressedThisFrame) {
-                clickProcessed = true;
-                wasPressed = true;
-                buttonPressedThisFrame = true;
-                action();
-            }
+        WonGame game = { difficulty, attempts, maxAttempts, timeLimit > 0, played < timeLimit, played };
+        for (int index : winAchievements(game)) unlock(index, out);
+        if (completionistEarned([this](int i) { return progress.achievements[i]; })) {
+            unlock(COMPLETIONIST_ACHIEVEMENT, out);
         }
-        else if (!sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
-            clickProcessed = false;
+        saveProgress();
+    }
+
+    void unlock(int index, std::ostream& out) {
+        if (progress.achievements[index]) return;
+        progress.achievements[index] = true;
+        out << "Achievement unlocked: " << ACHIEVEMENT_INFO[index].title << "\n";
+    }
+
+    void printShop(std::ostream& out) const {
+        out << "Points: " << progress.totalPoints << "\n";
+        for (int i = 0; i < SHOP_ITEM_COUNT; ++i) {
+            out << i + 1 << ". " << SHOP_ITEM_INFO[i].title << " - " << SHOP_ITEM_INFO[i].description << " ";
+            if (progress.purchased[i]) out << (progress.active[i] ? "[active]" : "[inactive]");
+            else out << "[" << SHOP_ITEM_INFO[i].cost << " points]";
+            out << "\n";
         }
     }
 
-    void draw(sf::RenderTarget& target) const {
-        if (!visible) return;
-        target.draw(shape);
-        target.draw(label);
+    // Same rules as the shop screen: buy if affordable, otherwise toggle an owned item
+    void purchase(int index, std::ostream& out) {
+        if (index < 0 || index >= SHOP_ITEM_COUNT) {
+            out << "No such item\n";
+            return;
+        }
+        if (!progress.purchased[index] && progress.totalPoints >= SHOP_ITEM_INFO[index].cost) {
+            progress.totalPoints -= SHOP_ITEM_INFO[index].cost;
+            progress.purchased[index] = true;
+            progress.active[index] = true;
+        }
+        else if (progress.purchased[index]) {
+            progress.active[index] = !progress.active[index];
+        }
+        else {
+            out << "Not enough points\n";
+            return;
+        }
+        out << SHOP_ITEM_INFO[index].title << (progress.active[index] ? " active\n" : " inactive\n");
+        saveProgress();
     }
 
-private:
-    sf::RectangleShape shape;
-    sf::Text label;
-    std::function<void()> action;
-    bool isHovered = false;
-    sf::Vector2f originalPosition;
-    sf::Vector2f targetPosition;
-    bool visible = true;
-    bool clickProcessed = false;
-    bool wasPressed = false;
-    bool hoverEffectActive = true;
-    int zIndex = 0;
-    float width;
-    float height;
-    int fontSize;
-
-    void updateTextPosition() {
-        label.setPosition(
-            shape.getPosition().x + (width - label.getLocalBounds().width) / 2.f,
-            shape.getPosition().y + (height - fontSize) / 2.f - 5.f
-        );
+    void saveProgress() {
+        profiles.write(profileSlot, progress);
+    }
+
+    // A game in progress is abandoned, as it was played on the old profile's perks
+    void switchProfile(const std::string& name, std::ostream& out) {
+        saveProgress();
+        int slot = profiles.select(name);
+        if (slot < 0) {
+            out << "Cannot switch to profile " << name << "\n";
+            return;
+        }
+        profileSlot = slot;
+        progress = SaveData();
+        profiles.read(profileSlot, progress);
+        playing = false;
+        out << "Profile " << profiles.name(profileSlot) << ": " << progress.totalPoints << " points\n";
+    }
+
+    void printAchievements(std::ostream& out) const {
+        for (int i = 0; i < ACHIEVEMENT_COUNT; ++i) {
+            out << (progress.achievements[i] ? "[x] " : "[ ] ") << ACHIEVEMENT_INFO[i].title
+                << " - " << ACHIEVEMENT_INFO[i].description << "\n";
+        }
     }
+
+    ProfileStore profiles;
+    int profileSlot = -1;
+    SaveData progress;
+    std::mt19937 rng;
+    int difficulty = 1;
+    int range = 100;
+    int maxAttempts = 0;
+    int timeLimit = 0;
+    int secretNumber = 0;
+    int attempts = 0;
+    bool playing = false;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+struct LaunchOptions {
+    bool threaded = false;      // run game logic on its own fixed-tick thread
+    bool perfReport = false;    // print frame time and input latency percentiles on exit
+    std::string metricsFile;    // periodically written Prometheus metrics, empty to disable
+    bool allocationCheck = false; // report heap allocations made by steady-state frames
+    std::string captureFile;    // session recording, .y4m file or PNG directory, empty to disable
+    bool offscreen = false;     // draw into a texture instead of the window, for headless capture
+    std::string traceFile;      // Chrome trace-event JSON written on exit, empty to disable; F9 pauses
+    std::size_t screenBudget = 0; // bytes of built screens kept warm, 0 for no limit
+    bool eagerScreens = false;  // build every screen at startup instead of on first entry
+    double soakMinutes = 0;     // length of a scripted soak run checked for resource drift, 0 to disable
+    double soakTolerance = 0.10; // growth of RSS and heap past the soak baseline that fails the run
+    std::string profile;        // player profile to select, created if new; empty for the one used last
 };
 
 class NumberGuesser {
 public:
-    enum Difficulty {
-        EASY,       // 1-50, unlimited attempts, no timer
-        MEDIUM,     // 1-100, 15 attempts, no timer
-        HARD,       // 1-200, 10 attempts, no timer
-        EXPERT,     // 1-500, 7 attempts, 2 minute timer
-        MASTER      // 1-1000, 5 attempts, 1 minute timer
-    };
+    // Indexes DIFFICULTY_RULES, which holds the range, attempts, timer and points of each
+    enum Difficulty { EASY, MEDIUM, HARD, EXPERT, MASTER };
 
-    enum GameState { MENU, PLAYING, ACHIEVEMENTS, DIFFICULTY, GAME_OVER, SHOP, SETTINGS };
+    enum GameState { MENU, PLAYING, ACHIEVEMENTS, DIFFICULTY, GAME_OVER, SHOP, SETTINGS, ANALYSIS };
 
-    NumberGuesser() {
+    explicit NumberGuesser(const LaunchOptions& options = LaunchOptions())
+        : options(options) {
+        sf::Int64 startupBegin = nowMicros();
+        Tracer::nameThread("main");
+        Tracer::setEnabled(!options.traceFile.empty());
         config.load();
+        describeLayout();
+        if (!options.metricsFile.empty()) {
+            metricsExporter = std::make_unique<MetricsExporter>(options.metricsFile, std::chrono::milliseconds(5000));
+        }
         createWindow();
+        if (!options.captureFile.empty()) {
+            recorder = std::make_unique<FrameRecorder>(options.captureFile, window->getSize());
+        }
         try {
             initResources();
+            profileSlot = openProfiles(profiles, options.profile);
             initGame();
+            publishSnapshot();
+            snapshots.fetch();
+            startupMicros = nowMicros() - startupBegin;
+            if (options.soakMinutes > 0) startSoak();
         }
         catch (const std::exception& e) {
             std::cerr << "Error: " << e.what() << std::endl;
+            FlightRecorder::get().record(FlightRecorder::FAILURE, e.what());
             window->close();
         }
     }
 
+    ~NumberGuesser() {
+        stopLogicThread();
+    }
+
     void createWindow() {
         if (config.fullscreen) {
             window = std::make_unique<sf::RenderWindow>(sf::VideoMode::getDesktopMode(), "Shaolin Number!", sf::Style::Fullscreen);
@@ -252,18 +4397,52 @@ public:
         else {
             window = std::make_unique<sf::RenderWindow>(sf::VideoMode(config.width, config.height), "Shaolin Number!", sf::Style::Close | sf::Style::Titlebar);
         }
+
+        // The window still delivers events, but frames go to a texture, which
+        // needs no visible surface (e.g. Xvfb with a software OpenGL renderer)
+        if (options.offscreen) {
+            window->setVisible(false);
+            if (!offscreenTarget.create(window->getSize().x, window->getSize().y)) {
+                throw std::runtime_error("Failed to create offscreen render target!");
+            }
+        }
+        windowInput = captureWindow();
+        resolveLayout();
     }
 
     void run() {
-        sf::Clock clock;
-        while (window->isOpen()) {
-            sf::Time deltaTime = clock.restart();
-            handleEvents();
-            update(deltaTime);
-            render();
+        if (options.threaded) {
+            runThreaded();
+        }
+        else {
+            runSingleThreaded();
+        }
+        if (soakMonitor) finishSoak();
+
+        if (!options.traceFile.empty()) {
+            Tracer::setEnabled(false);
+            if (!Tracer::writeChromeJson(options.traceFile)) {
+                std::cerr << "Error: Failed to write trace to " << options.traceFile << std::endl;
+            }
+        }
+        if (options.perfReport) {
+            frameTimes.report(std::cout);
+            inputLatency.report(std::cout);
+            governor.report(std::cout);
+            reportScreens(std::cout);
+            ResourceManager::reportTextures(std::cout);
+            sfx.report(std::cout);
+            std::cout << "music: " << music.getUnderruns() << " underruns, lowest decode-ahead "
+                << std::fixed << std::setprecision(2) << music.getLowestBufferedSeconds() << " s" << std::endl;
+        }
+        if (options.allocationCheck) {
+            std::cout << "steady frames with heap allocations: " << allocatingFrameCount
+                << " of " << steadyFrameCount << std::endl;
         }
     }
 
+    bool soakPassed() const { return !soakDrifted && !soak.stalled; }
+
 private:
     struct GuessHistory {
         int value;
@@ -291,8 +4470,98 @@ private:
         }
     };
 
+    struct EffectRequest {
+        enum Kind { CONFETTI, EMBERS, SPARKS } kind = CONFETTI;
+        sf::FloatRect area;
+        int count = 0;
+    };
+    static const std::uint32_t EFFECT_RING_SIZE = 16;
+
+    typedef WidgetSet ButtonSet;
+
+    // The widgets of a screen; PLAYING and GAME_OVER share one
+    enum ScreenId { MENU_SCREEN, GAME_SCREEN, DIFFICULTY_SCREEN, ACHIEVEMENTS_SCREEN, SHOP_SCREEN, SETTINGS_SCREEN, ANALYSIS_SCREEN, SCREEN_COUNT };
+
+    struct Screen {
+        explicit Screen(WidgetPool& pool) : buttons(pool) {}
+
+        ButtonSet buttons;
+        std::size_t bytes = 0;          // heap allocated while building it
+        std::uint64_t lastUsed = 0;     // screenSwitches when it was last entered
+    };
+
+    struct ScreenStats {
+        int builds;
+        int releases;
+        sf::Int64 buildMicros;
+        std::size_t bytes;
+    };
+
+    // A released screen stays alive until the renderer has drawn a snapshot
+    // published after the release, as older snapshots may still point at it
+    struct RetiredScreen {
+        std::unique_ptr<Screen> screen;
+        std::uint64_t lastSnapshot;
+    };
+
+    // Everything the render pass reads, copied out of the game state once per
+    // update tick so drawing never observes a half-updated frame
+    struct RenderSnapshot {
+        std::uint64_t sequence = 0;
+        const Screen* screen = nullptr;
+        GameState state = MENU;
+        Difficulty difficulty = MEDIUM;
+        int attempts = 0;
+        int maxAttempts = 0;
+        int range = 100;
+        int secretNumber = 0;
+        int totalPoints = 0;
+        bool gameWon = false;
+        bool timeUp = false;
+        bool timerActive = false;
+        sf::Time timeRemaining;
+        int timerWarning = 0;
+        bool timerBlinkOn = false;
+        std::string inputStr;
+        std::string currentHint;
+        sf::Color inputColor;
+        std::vector<GuessHistory> guessHistory;
+        std::vector<GuessAnalysis> analysis;
+        std::vector<char> achievementUnlocked;
+        std::vector<char> shopPurchased;
+        std::vector<char> shopActive;
+        std::string profileName;    // empty while progress cannot be saved
+        int toastAchievement = -1;
+        float toastAlpha = 0.f;
+        float titleScale = 1.f;
+        float titleRotation = 0.f;
+        float titleOutline = 2.f;
+        sf::Color titleColor;
+        std::vector<ButtonVisual> buttonVisuals;
+        int staticLayerVersion = 0;
+        std::array<EffectRequest, EFFECT_RING_SIZE> effects;
+        std::uint32_t effectSequence = 0;
+        sf::Int64 inputStamp = 0;
+        sf::Int64 commandStamp = 0;
+    };
+
+    struct TimedEvent {
+        sf::Event event;
+        sf::Int64 stamp;
+        WindowInput window;
+    };
+
+    LaunchOptions options;
+    Telemetry& telemetry = Telemetry::get();
+    std::unique_ptr<MetricsExporter> metricsExporter;
     Config config;
+    ProfileStore profiles;
+    int profileSlot = -1;       // -1 while progress cannot be saved
     std::unique_ptr<sf::RenderWindow> window;
+    WindowInput windowInput;    // the logic's view of the window, refreshed with every event
+    sf::RenderTexture offscreenTarget;
+    std::unique_ptr<FrameRecorder> recorder;
+    sf::RenderTarget* screen = nullptr;     // what render() draws into: the window or offscreenTarget
     GameState state = MENU;
     Difficulty difficulty = MEDIUM;
 
@@ -305,38 +4574,96 @@ private:
     bool gameWon = false;
     bool gameLost = false;
     std::vector<GuessHistory> guessHistory;
+    std::vector<GuessClue> gameClues;       // every guess of the current game, unlike the trimmed history
+    std::vector<GuessAnalysis> gameAnalysis;
+    GameState analysisReturnState = PLAYING;
     std::string inputStr;
     std::string currentHint = "Make your guess!";
     sf::Color inputColor = sf::Color::White;
 
+    enum TimerEvent {
+        GAME_TIMEOUT,
+        LOW_TIME_WARNING,       // 30 s left
+        CRITICAL_TIME_WARNING,  // 10 s left, timer starts blinking
+        TIMER_SECOND_TICK,      // refreshes the mm:ss display
+        TIMER_BLINK,
+        TOAST_EXPIRED
+    };
+
+    GameClock gameTime;
+    DeadlineScheduler deadlines;
     sf::Time timeLimit;
     sf::Time timeRemaining;
-    sf::Clock gameClock;
+    sf::Time gameStartTime;
+    sf::Time gameEndTime;
+    int timerWarning = 0;
+    bool timerBlinkOn = false;
     bool timerActive = false;
     bool timeUp = false;
 
-    sf::Music bgMusic;
-    sf::Sound clickSound;
-    sf::Sound winSound;
-    sf::Sound loseSound;
-    std::vector<std::unique_ptr<Button>> buttons;
-    std::vector<std::unique_ptr<Button>> gameButtons;
-    std::vector<std::unique_ptr<Button>> difficultyButtons;
-    std::vector<std::unique_ptr<Button>> achievementButtons;
-    std::vector<std::unique_ptr<Button>> shopButtons;
-    std::vector<std::unique_ptr<Button>> settingsButtons;
+    // Music moods, each with a playlist played in order and looped
+    enum MusicMood { MENU_MUSIC, GAME_MUSIC, TENSION_MUSIC };
+    MusicPlayer music;
+    MusicMood musicMood = MENU_MUSIC;
+    std::size_t musicTrack = 0;
+    bool musicStalled = false;
+    std::vector<std::string> missingMusic;
+
+    SfxEngine sfx;
+
+    // Declared before the screens, whose widget sets release into it
+    WidgetPool widgets;
+
+    // Built on first entry and released, least recently used first, when the
+    // built screens outgrow options.screenBudget
+    std::array<std::unique_ptr<Screen>, SCREEN_COUNT> screens;
+    std::array<ScreenStats, SCREEN_COUNT> screenStats = {};
+    std::vector<RetiredScreen> retiredScreens;
+    std::uint64_t screenSwitches = 0;
+    std::uint64_t publishedSnapshots = 0;
+    std::atomic<std::uint64_t> renderedSnapshot{ 0 };
+    std::size_t peakScreenBytes = 0;
+    sf::Int64 startupMicros = 0;
+    WidgetPool::Handle analysisButton;
+
+    // Scripted player of --soak, driven from the main thread
+    static const int SOAK_SAMPLES = 120;                    // over the whole run, at least a second apart
+    static const sf::Int64 SOAK_ACTION_MICROS = 150000;     // between two clicks or typed guesses
+    static constexpr double SOAK_WARMUP_MINUTES = 2.0;      // covers a pass over every difficulty and resolution
+    static const sf::Int64 SOAK_STALL_MICROS = 60000000;    // longest a menu round may take before the script counts as stuck
+    struct SoakScript {
+        sf::Int64 started = 0;
+        sf::Int64 nextAction = 0;
+        sf::Int64 nextSample = 0;
+        sf::Int64 sampleInterval = 0;
+        int menuStep = 0;           // menu entries opened so far, in Play..Settings order
+        int resolutionSwitches = 0;
+        sf::Int64 lastMenuStep = 0;
+        sf::Int64 lastResolutionSwitch = 0;
+        bool stalled = false;
+        int games = 0;
+        int low = 1;                // bisection bounds of the game being played, high 0 until it starts
+        int high = 0;
+        bool analysisSeen = false;
+        bool resized = false;
+        std::size_t shopClicks = 0;
+        Config restore;             // the resolution switches must not outlive the run
+    } soak;
+    std::unique_ptr<SoakMonitor> soakMonitor;
+    bool soakDrifted = false;
     sf::Text title;
     sf::Sprite background;
-    sf::Clock titleAnimationClock;
-    float titleScale = 1.0f;
-    bool titleGrowing = true;
-    float titleRotation = 0.0f;
     sf::Color titleColor = sf::Color::White;
-    float colorHue = 0.0f;
-    float outlineThickness = 0.f;
-    bool outlineGrowing = true;
-    bool buttonPressedThisFrame = false;
-    bool shopButtonPressed = false;
+    TweenScheduler::TweenId titleScale = TweenScheduler::INVALID;
+    TweenScheduler::TweenId titleRotation = TweenScheduler::INVALID;
+    TweenScheduler::TweenId titleHue = TweenScheduler::INVALID;
+    TweenScheduler::TweenId titleOutline = TweenScheduler::INVALID;
+    TweenScheduler::TweenId toastAlpha = TweenScheduler::INVALID;
+    PressQueue pendingPresses;
+    CommandQueue uiCommands;
+    sf::Int64 lastCommandStamp = 0;
+    GameState recordedState = MENU;     // last state logged to the flight recorder
+    QualityGovernor::Level appliedQuality = QualityGovernor::FULL;
 
     // Shop items and abilities
     std::vector<ShopItem> shopItems;
@@ -357,21 +4684,110 @@ private:
         }
     };
     std::vector<Achievement> achievements;
-    sf::Clock achievementDisplayClock;
     std::string lastUnlockedAchievement;
 
+    // Update side: published to the renderer through the snapshot triple buffer
+    TripleBuffer<RenderSnapshot> snapshots;
+    std::array<EffectRequest, EFFECT_RING_SIZE> effectRing;
+    std::uint32_t effectSequence = 0;
+    int staticLayerVersion = 0;
+    sf::Int64 lastInputStamp = 0;
+
+    // Threaded mode: window events flow to the logic thread through inputQueue,
+    // requests that need the window flow back through the atomics
+    std::thread logicThread;
+    std::atomic<bool> logicRunning{ false };
+    std::atomic<bool> closeRequested{ false };
+    std::atomic<bool> settingsRequested{ false };
+    std::atomic<int> qualityLevel{ QualityGovernor::FULL };
+    SpscQueue<TimedEvent, 256> inputQueue;
+
+    // Render side
+    const RenderSnapshot* frame = nullptr;
+    ParticleSystem particles;
+    std::uint32_t consumedEffects = 0;
+    sf::Clock presentClock;
+    sf::Int64 lastPresentedInput = 0;
+    sf::Int64 lastPresentedCommand = 0;
+    PerfStats frameTimes{ "frame time" };
+    PerfStats inputLatency{ "input latency" };
+    QualityGovernor governor;
+    sf::Int64 lastRenderStart = 0;
+    static const sf::Int64 FLIGHT_FRAME_WINDOW = 250000;
+    sf::Int64 flightWindowStart = 0;
+    std::int64_t flightFrames = 0;
+    sf::Int64 flightWorstFrame = 0;
+
+    // Persistent drawables for per-frame content, so steady frames do not allocate
+    std::vector<std::size_t> buttonOrder;
+    CachedText pointsLabel;
+    CachedText attemptsLabel;
+    CachedText timerLabel;
+    CachedText inputLabel;
+    CachedText hintLabel;
+    CachedText winLabel;
+    CachedText timeLeftLabel;
+    CachedText toastLabel;
+    std::vector<CachedText> historyLabels;
+    sf::RectangleShape toastBg;
+
+    // Layout nodes of every screen, see describeLayout
+    static const int MENU_BUTTONS = 6;
+    static const int GAME_BUTTONS = 3;
+    static const int SETTINGS_BUTTONS = 5;
+    struct ScreenNodes {
+        UiLayout::Node menu[MENU_BUTTONS];
+        UiLayout::Node game[GAME_BUTTONS];
+        UiLayout::Node difficulty[DIFFICULTY_COUNT];
+        UiLayout::Node difficultyInfo[DIFFICULTY_COUNT];
+        UiLayout::Node settings[SETTINGS_BUTTONS];
+        UiLayout::Node shopRows[SHOP_ITEM_COUNT];
+        UiLayout::Node shopBuy[SHOP_ITEM_COUNT];
+        UiLayout::Node back, difficultyBack, settingsBack, shopArea, profile, profileName;
+        UiLayout::Node points, attempts, timer, inputBox, input, hint, history, win, timeLeft, toast, toastText;
+    };
+    UiLayout layout;
+    ScreenNodes ui;
+    sf::Vector2f historyCell;
+    int historyColumns = 1;
+    int historyRows = 1;
+
+    // Frames since the screen or its static layer last changed
+    static const int STEADY_AFTER_FRAMES = 120;
+    int steadyFrames = 0;
+    std::uint64_t steadyFrameCount = 0;
+    std::uint64_t allocatingFrameCount = 0;
+    unsigned reportedAllocationScreens = 0;
+
+    // Everything on the current screen that only changes on resize or data
+    // change, pre-composited so a frame starts with a single opaque blit
+    sf::RenderTexture staticLayer;
+    sf::Sprite staticLayerSprite;
+    int staticLayerRendered = -1;
+    float staticLayerScale = 1.f;
+    bool staticLayerAvailable = true;
+    GameState staticLayerState = MENU;
+
     void initResources() {
-        if (!bgMusic.openFromFile(RESOURCES_DIR + "garmoniya-in-yan-278.mp3")) {
+        TraceZone zone("initResources");
+        musicMood = musicMoodFor();
+        bool musicQueued;
+        {
+            ScopedMetricTimer musicTimer(Telemetry::get().assetLoad, FlightRecorder::ASSET, "music");
+            musicQueued = queueMusic(false);
+        }
+        if (!musicQueued) {
             throw std::runtime_error("Failed to load background music!");
         }
-        bgMusic.setLoop(true);
-        bgMusic.play();
 
-        clickSound.setBuffer(ResourceManager::getClickSound());
-        winSound.setBuffer(ResourceManager::getWinSound());
-        loseSound.setBuffer(ResourceManager::getLoseSound());
+        // Clicks come in bursts; a win or loss plays at most once per game
+        // but must not be cut off by them
+        sfx.registerSound(SFX_CLICK, ResourceManager::getClickSound(), SFX_UI, 1, 6);
+        sfx.registerSound(SFX_WIN, ResourceManager::getWinSound(), SFX_GAME, 3, 3);
+        sfx.registerSound(SFX_LOSE, ResourceManager::getLoseSound(), SFX_GAME, 3, 3);
+        sfx.setCategoryVolume(SFX_UI, config.uiVolume);
+        sfx.setCategoryVolume(SFX_GAME, config.gameVolume);
 
-        background.setTexture(ResourceManager::getBackgroundTexture());
         updateBackgroundScale();
 
         title.setFont(ResourceManager::getFont());
@@ -396,53 +4812,161 @@ private:
         title.setOutlineThickness(2.f);
         updateTitlePosition();
 
-        achievements = {
-            {"Beginner", "Complete first game", false},
-            {"Pro", "Win in 5 tries", false},
-            {"Legend", "Win on first try", false},
-            {"Time Master", "Win on Expert/Master with time left", false},
-            {"Perfect Guess", "Win on Master difficulty", false},
-            {"Hot Streak", "Win 3 games in a row", false},
-            {"Number Ninja", "Win on all difficulty levels", false},
-            {"Persistent", "Make 10 wrong guesses in one game", false},
-            {"Close Call", "Win with last attempt", false},
-            {"Speed Demon", "Win in under 30 seconds", false},
-            {"Cold Blooded", "Win with freezing guess", false},
-            {"Completionist", "Unlock all achievements", false}
-        };
+        TweenScheduler& tweens = TweenScheduler::instance();
+        titleScale = tweens.create(0.9f);
+        tweens.play(titleScale, 0.9f, 1.1f, 0.67f, Ease::Linear, TweenScheduler::PING_PONG);
+        titleRotation = tweens.create(-3.f);
+        tweens.play(titleRotation, -3.f, 3.f, 2.1f, Ease::InOutSine, TweenScheduler::PING_PONG);
+        titleHue = tweens.create(0.f);
+        tweens.play(titleHue, 0.f, 360.f, 8.f, Ease::Linear, TweenScheduler::LOOP);
+        titleOutline = tweens.create(1.f);
+        tweens.play(titleOutline, 1.f, 3.f, 2.5f, Ease::Linear, TweenScheduler::PING_PONG);
+        toastAlpha = tweens.create(0.f);
+
+        achievements.clear();
+        for (const auto& info : ACHIEVEMENT_INFO) {
+            achievements.emplace_back(info.title, info.description, false);
+        }
 
         // Initialize shop items
+        auto item = [](ShopPerk perk, std::function<void()> apply, std::function<void()> remove) {
+            const CatalogEntry& info = SHOP_ITEM_INFO[perk];
+            return ShopItem(info.title, info.description, info.cost, false, false, apply, remove);
+        };
         shopItems = {
-            {"Hint Helper", "Shows hint after wrong guess", 100, false, false,
+            item(HINT_HELPER,
                 [this]() { showHintAfterWrongGuess = true; },
-                [this]() { showHintAfterWrongGuess = false; }},
+                [this]() { showHintAfterWrongGuess = false; }),
 
-            {"Range Revealer", "Shows range after 3 attempts", 200, false, false,
+            item(RANGE_REVEALER,
                 [this]() { showRangeAfterFewAttempts = true; },
-                [this]() { showRangeAfterFewAttempts = false; }},
+                [this]() { showRangeAfterFewAttempts = false; }),
 
-            {"Extra Attempt", "+1 attempt in each game", 300, false, false,
+            item(EXTRA_ATTEMPT,
                 [this]() { extraAttempt = true; },
-                [this]() { extraAttempt = false; }},
+                [this]() { extraAttempt = false; }),
 
-            {"Time Extender", "+30 sec in timed modes", 400, false, false,
+            item(TIME_EXTENDER,
                 [this]() { timeExtension = true; },
-                [this]() { timeExtension = false; }},
+                [this]() { timeExtension = false; }),
 
-            {"Odd/Even Hint", "Shows if number is odd/even", 150, false, false,
+            item(ODD_EVEN_HINT,
                 [this]() { showEvenOdd = true; },
-                [this]() { showEvenOdd = false; }}
+                [this]() { showEvenOdd = false; })
         };
     }
 
     float getScaleFactor() const {
-        // Base resolution is 800x600
-        float scaleX = static_cast<float>(window->getSize().x) / 800.f;
-        float scaleY = static_cast<float>(window->getSize().y) / 600.f;
-        return std::min(scaleX, scaleY);
+        return layout.scale();
+    }
+
+    // Every screen's buttons and per-frame labels, in design units. The static
+    // layers still measure their own text, as they are painted only when they change.
+    void describeLayout() {
+        const sf::Vector2f TOP_LEFT(0.f, 0.f);
+        const sf::Vector2f TOP_CENTER(0.5f, 0.f);
+        const sf::Vector2f TOP_RIGHT(1.f, 0.f);
+        const sf::Vector2f BOTTOM_RIGHT(1.f, 1.f);
+
+        for (UiLayout::Node& node : ui.menu) node = layout.box(220.f, 50.f);
+        layout.place(layout.stack(UiLayout::COLUMN, ui.menu, MENU_BUTTONS, 25.f), sf::Vector2f(0.1f, 0.3f), TOP_LEFT);
+
+        const float gameButtonCenters[GAME_BUTTONS] = { 1.f / 6.f, 5.f / 6.f, 0.5f };
+        for (int i = 0; i < GAME_BUTTONS; ++i) {
+            ui.game[i] = layout.box(220.f, 50.f);
+            layout.place(ui.game[i], sf::Vector2f(gameButtonCenters[i], 0.85f), TOP_CENTER);
+        }
+
+        // Each difficulty is a button over its description; three on the first row, two centred below
+        UiLayout::Node cards[DIFFICULTY_COUNT];
+        for (int d = 0; d < DIFFICULTY_COUNT; ++d) {
+            ui.difficulty[d] = layout.box(200.f, 45.f);
+            ui.difficultyInfo[d] = layout.box(200.f, 100.f);
+            cards[d] = layout.stack(UiLayout::COLUMN, { ui.difficulty[d], ui.difficultyInfo[d] }, 10.f);
+        }
+        UiLayout::Node firstRow = layout.stack(UiLayout::ROW, cards, 3, 30.f);
+        UiLayout::Node secondRow = layout.stack(UiLayout::ROW, cards + 3, DIFFICULTY_COUNT - 3, 30.f);
+        layout.place(layout.stack(UiLayout::COLUMN, { firstRow, secondRow }, 10.f, UiLayout::CENTER),
+            sf::Vector2f(0.5f, 0.3f), TOP_CENTER);
+
+        for (UiLayout::Node& node : ui.settings) node = layout.box(220.f, 45.f);
+        layout.place(layout.stack(UiLayout::COLUMN, ui.settings, SETTINGS_BUTTONS, 25.f), sf::Vector2f(0.6f, 0.3f), TOP_LEFT);
+        ui.profile = layout.box(220.f, 45.f);
+        layout.place(ui.profile, sf::Vector2f(0.1f, 0.3f), TOP_LEFT);
+        ui.profileName = layout.pin(sf::Vector2f(0.1f, 0.3f), sf::Vector2f(0.f, 60.f));
+
+        // Shop rows are the item's text with its button in the lower right corner;
+        // rows that run past the bottom of the area are not shown
+        ui.shopArea = layout.box(700.f, 350.f);
+        layout.place(ui.shopArea, TOP_CENTER, TOP_CENTER, sf::Vector2f(0.f, 150.f));
+        for (int i = 0; i < SHOP_ITEM_COUNT; ++i) {
+            ui.shopBuy[i] = layout.box(100.f, 30.f);
+            UiLayout::Node buyColumn = layout.stack(UiLayout::COLUMN, { layout.box(100.f, 40.f), ui.shopBuy[i] }, 0.f);
+            ui.shopRows[i] = layout.stack(UiLayout::ROW, { layout.box(570.f, 80.f), buyColumn, layout.box(10.f, 0.f) }, 0.f);
+        }
+        layout.place(layout.stack(UiLayout::COLUMN, ui.shopRows, SHOP_ITEM_COUNT, 15.f), TOP_CENTER, TOP_CENTER,
+            sf::Vector2f(0.f, 160.f));
+
+        const sf::Vector2f corner(-30.f, -30.f);
+        ui.back = layout.box(220.f, 50.f);
+        layout.place(ui.back, BOTTOM_RIGHT, BOTTOM_RIGHT, corner);
+        ui.difficultyBack = layout.box(200.f, 45.f);
+        layout.place(ui.difficultyBack, BOTTOM_RIGHT, BOTTOM_RIGHT, corner);
+        ui.settingsBack = layout.box(220.f, 45.f);
+        layout.place(ui.settingsBack, BOTTOM_RIGHT, BOTTOM_RIGHT, corner);
+
+        ui.points = layout.pin(TOP_RIGHT, sf::Vector2f(-30.f, 30.f));
+        ui.attempts = layout.pin(TOP_RIGHT, sf::Vector2f(-30.f, 70.f));
+        ui.timer = layout.pin(TOP_CENTER, sf::Vector2f(0.f, 70.f));
+        ui.inputBox = layout.box(400.f, 80.f);
+        layout.place(ui.inputBox, TOP_LEFT, TOP_LEFT, sf::Vector2f(50.f, 120.f));
+        ui.input = layout.pin(TOP_LEFT, sf::Vector2f(60.f, 160.f));
+        ui.hint = layout.pin(TOP_LEFT, sf::Vector2f(470.f, 140.f));
+        ui.history = layout.pin(TOP_LEFT, sf::Vector2f(50.f, 260.f));
+        ui.win = layout.pin(TOP_CENTER, sf::Vector2f(0.f, 400.f));
+        ui.timeLeft = layout.pin(TOP_CENTER, sf::Vector2f(0.f, 460.f));
+        ui.toast = layout.box(500.f, 80.f);
+        layout.place(ui.toast, TOP_CENTER, TOP_CENTER, sf::Vector2f(0.f, 50.f));
+        ui.toastText = layout.pin(TOP_CENTER, sf::Vector2f(0.f, 70.f));
+    }
+
+    // Recomputes the layout and everything positioned from it, but only when
+    // the window size changed; frames in between read the cached rectangles
+    void resolveLayout() {
+        if (!layout.resolve(window->getSize())) return;
+        const float scale = layout.scale();
+
+        pointsLabel.setAnchor(layout.point(ui.points), 1.f);
+        attemptsLabel.setAnchor(layout.point(ui.attempts), 1.f);
+        timerLabel.setAnchor(layout.point(ui.timer), 0.5f);
+        inputLabel.setAnchor(layout.point(ui.input), 0.f);
+        hintLabel.setAnchor(layout.point(ui.hint), 0.f);
+        winLabel.setAnchor(layout.point(ui.win), 0.5f);
+        timeLeftLabel.setAnchor(layout.point(ui.timeLeft), 0.5f);
+        toastLabel.setAnchor(layout.point(ui.toastText), 0.5f);
+
+        const sf::FloatRect& toast = layout.rect(ui.toast);
+        toastBg.setSize(sf::Vector2f(toast.width, toast.height));
+        toastBg.setPosition(toast.left, toast.top);
+        toastBg.setOutlineThickness(2.f * scale);
+
+        // Guesses fill rows of 300 design units down to 100 above the bottom edge
+        historyCell = sf::Vector2f(static_cast<float>(static_cast<int>(300 * scale)), static_cast<float>(static_cast<int>(40 * scale)));
+        historyColumns = std::max(1, static_cast<int>((window->getSize().x - 100 * scale) / historyCell.x));
+        historyRows = std::max(1, static_cast<int>((window->getSize().y - 100 * scale - layout.point(ui.history).y) / historyCell.y) + 1);
+        for (std::size_t i = 0; i < historyLabels.size(); ++i) {
+            historyLabels[i].setAnchor(historyPosition(i), 0.f);
+        }
+    }
+
+    sf::Vector2f historyPosition(std::size_t index) const {
+        int row = static_cast<int>(index) / historyColumns;
+        int col = static_cast<int>(index) % historyColumns;
+        return layout.point(ui.history) + sf::Vector2f(col * 300.f * layout.scale(), row * historyCell.y);
     }
 
     void updateBackgroundScale() {
+        background.setTexture(ResourceManager::getBackgroundTexture(window->getSize()), true);
         sf::Vector2u textureSize = background.getTexture()->getSize();
         background.setScale(
             static_cast<float>(window->getSize().x) / static_cast<float>(textureSize.x),
@@ -458,213 +4982,164 @@ private:
     }
 
     void initGame() {
+        TraceZone zone("initGame");
         loadProgress();
-        createMenu();
-        createGameButtons();
-        createDifficultyButtons();
-        createAchievementButtons();
-        createShopButtons();
-        createSettingsButtons();
-    }
-
-    void createMenu() {
-        buttons.clear();
-        float buttonWidth = 220.f * getScaleFactor();
-        float buttonHeight = 50.f * getScaleFactor();
-        float buttonX = window->getSize().x * 0.1f;
-        float startY = window->getSize().y * 0.3f;
-        float spacing = 25.f * getScaleFactor();
-
-        buttons.push_back(std::make_unique<Button>("Play", sf::Vector2f(buttonX, startY), [this]() {
-            clickSound.play();
-            startNewGame();
-            }, 1, buttonWidth, buttonHeight, static_cast<int>(24 * getScaleFactor())));
+        if (options.eagerScreens) {
+            for (int id = 0; id < SCREEN_COUNT; ++id) ensureScreen(static_cast<ScreenId>(id));
+        }
+        ensureScreen(screenFor(state));
+    }
 
-        buttons.push_back(std::make_unique<Button>("Difficulty", sf::Vector2f(buttonX, startY + buttonHeight + spacing), [this]() {
-            clickSound.play();
-            state = DIFFICULTY;
-            updateButtonVisibility();
-            }, 2, buttonWidth, buttonHeight, static_cast<int>(24 * getScaleFactor())));
+    static ScreenId screenFor(GameState state) {
+        switch (state) {
+        case PLAYING:
+        case GAME_OVER: return GAME_SCREEN;
+        case DIFFICULTY: return DIFFICULTY_SCREEN;
+        case ACHIEVEMENTS: return ACHIEVEMENTS_SCREEN;
+        case SHOP: return SHOP_SCREEN;
+        case SETTINGS: return SETTINGS_SCREEN;
+        case ANALYSIS: return ANALYSIS_SCREEN;
+        case MENU:
+        default: return MENU_SCREEN;
+        }
+    }
 
-        buttons.push_back(std::make_unique<Button>("Achievements", sf::Vector2f(buttonX, startY + (buttonHeight + spacing) * 2), [this]() {
-            clickSound.play();
-            state = ACHIEVEMENTS;
-            updateButtonVisibility();
-            }, 3, buttonWidth, buttonHeight, static_cast<int>(24 * getScaleFactor())));
+    static const char* screenName(ScreenId id) {
+        static const char* names[SCREEN_COUNT] = { "menu", "game", "difficulty", "achievements", "shop", "settings", "analysis" };
+        return names[id];
+    }
 
-        buttons.push_back(std::make_unique<Button>("Shop", sf::Vector2f(buttonX, startY + (buttonHeight + spacing) * 3), [this]() {
-            clickSound.play();
-            state = SHOP;
-            updateButtonVisibility();
-            }, 4, buttonWidth, buttonHeight, static_cast<int>(24 * getScaleFactor())));
+    Screen& ensureScreen(ScreenId id) {
+        std::unique_ptr<Screen>& slot = screens[id];
+        if (slot) return *slot;
+
+        TraceZone zone("buildScreen");
+        std::uint64_t bytesBefore = AllocationTracker::local().bytes;
+        sf::Int64 start = nowMicros();
+        slot.reset(new Screen(widgets));
+        switch (id) {
+        case MENU_SCREEN: createMenu(slot->buttons); break;
+        case GAME_SCREEN: createGameButtons(slot->buttons); break;
+        case DIFFICULTY_SCREEN: createDifficultyButtons(slot->buttons); break;
+        case ACHIEVEMENTS_SCREEN: createAchievementButtons(slot->buttons); break;
+        case SHOP_SCREEN: createShopButtons(slot->buttons); break;
+        case SETTINGS_SCREEN: createSettingsButtons(slot->buttons); break;
+        case ANALYSIS_SCREEN: createAnalysisButtons(slot->buttons); break;
+        case SCREEN_COUNT: break;
+        }
+        for (WidgetPool::Handle btn : slot->buttons) widgets.setHoverAnimated(btn, QualityGovernor::animatesHover(appliedQuality));
+
+        // Pool slots are allocated up front, so count them along with what building allocated
+        std::size_t counted = static_cast<std::size_t>(AllocationTracker::local().bytes - bytesBefore);
+        slot->bytes = counted + sizeof(Screen) + slot->buttons.size() * WidgetPool::bytesPerWidget();
+
+        ScreenStats& stats = screenStats[id];
+        ++stats.builds;
+        stats.buildMicros += nowMicros() - start;
+        stats.bytes = slot->bytes;
+        FlightRecorder::get().record(FlightRecorder::ASSET, screenName(id), nowMicros() - start, static_cast<std::int64_t>(slot->bytes));
+        return *slot;
+    }
 
-        buttons.push_back(std::make_unique<Button>("Settings", sf::Vector2f(buttonX, startY + (buttonHeight + spacing) * 4), [this]() {
-            clickSound.play();
-            state = SETTINGS;
-            updateButtonVisibility();
-            }, 5, buttonWidth, buttonHeight, static_cast<int>(24 * getScaleFactor())));
+    // Releases least recently used screens other than the current one until
+    // the built ones fit the budget
+    void enforceScreenBudget(ScreenId current) {
+        std::size_t total = 0;
+        for (const auto& slot : screens) {
+            if (slot) total += slot->bytes;
+        }
+        peakScreenBytes = std::max(peakScreenBytes, total);
 
-        buttons.push_back(std::make_unique<Button>("Exit", sf::Vector2f(buttonX, startY + (buttonHeight + spacing) * 5), [this]() {
-            window->close();
-            }, 6, buttonWidth, buttonHeight, static_cast<int>(24 * getScaleFactor())));
+        while (options.screenBudget > 0 && total > options.screenBudget) {
+            int victim = -1;
+            for (int id = 0; id < SCREEN_COUNT; ++id) {
+                if (id == current || !screens[id]) continue;
+                if (victim < 0 || screens[id]->lastUsed < screens[victim]->lastUsed) victim = id;
+            }
+            if (victim < 0) break;
+            total -= screens[victim]->bytes;
+            releaseScreen(static_cast<ScreenId>(victim));
+        }
     }
 
-    void createGameButtons() {
-        gameButtons.clear();
-        float buttonWidth = 220.f * getScaleFactor();
-        float buttonHeight = 50.f * getScaleFactor();
-        float buttonY = window->getSize().y * 0.85f;
-        float spacing = 30.f * getScaleFactor();
+    void releaseScreen(ScreenId id) {
+        if (!screens[id]) return;
+        RetiredScreen retired = { std::move(screens[id]), publishedSnapshots };
+        retiredScreens.push_back(std::move(retired));
+        ++screenStats[id].releases;
+    }
 
-        gameButtons.push_back(std::make_unique<Button>("Restart", sf::Vector2f(window->getSize().x * 0.25f - buttonWidth / 2, buttonY), [this]() {
-            clickSound.play();
-            startNewGame();
-            }, 1, buttonWidth, buttonHeight, static_cast<int>(24 * getScaleFactor())));
+    void collectRetiredScreens() {
+        std::uint64_t rendered = renderedSnapshot.load(std::memory_order_acquire);
+        retiredScreens.erase(std::remove_if(retiredScreens.begin(), retiredScreens.end(),
+            [rendered](const RetiredScreen& retired) { return rendered > retired.lastSnapshot; }), retiredScreens.end());
+    }
 
-        gameButtons.push_back(std::make_unique<Button>("Menu", sf::Vector2f(window->getSize().x * 0.75f - buttonWidth / 2, buttonY), [this]() {
-            clickSound.play();
-            state = MENU;
-            updateButtonVisibility();
-            }, 2, buttonWidth, buttonHeight, static_cast<int>(24 * getScaleFactor())));
-    }
-
-    void createDifficultyButtons() {
-        difficultyButtons.clear();
-        float buttonWidth = 200.f * getScaleFactor();
-        float buttonHeight = 45.f * getScaleFactor();
-        float startY = window->getSize().y * 0.3f;
-        float spacingX = 30.f * getScaleFactor();
-        float spacingY = 40.f * getScaleFactor();
-        float descOffset = 60.f * getScaleFactor();
-
-        // Calculate total width for centered positioning
-        float totalWidth = (buttonWidth * 3) + (spacingX * 2);
-        float startX = (window->getSize().x - totalWidth) / 2;
-
-        // First row - Easy, Medium, Hard
-        difficultyButtons.push_back(std::make_unique<Button>("Easy", sf::Vector2f(startX, startY), [this]() {
-            difficulty = EASY;
-            clickSound.play();
-            state = MENU;
-            updateButtonVisibility();
-            }, 1, buttonWidth, buttonHeight, static_cast<int>(22 * getScaleFactor())));
+    void reportScreens(std::ostream& out) const {
+        out << "startup: " << std::fixed << std::setprecision(2) << startupMicros / 1000.0 << " ms ("
+            << (options.eagerScreens ? "eager" : "lazy") << " screens), peak screen memory " << peakScreenBytes << " bytes" << std::endl;
+        for (int id = 0; id < SCREEN_COUNT; ++id) {
+            const ScreenStats& stats = screenStats[id];
+            out << "  " << screenName(static_cast<ScreenId>(id)) << ": ";
+            if (stats.builds == 0) {
+                out << "never built" << std::endl;
+                continue;
+            }
+            out << stats.builds << " builds, " << stats.releases << " releases, " << stats.bytes << " bytes, "
+                << stats.buildMicros / 1000.0 / stats.builds << " ms per build" << std::endl;
+        }
+    }
 
-        difficultyButtons.push_back(std::make_unique<Button>("Medium", sf::Vector2f(startX + buttonWidth + spacingX, startY), [this]() {
-            difficulty = MEDIUM;
-            clickSound.play();
-            state = MENU;
-            updateButtonVisibility();
-            }, 2, buttonWidth, buttonHeight, static_cast<int>(22 * getScaleFactor())));
+    // A button filling the layout rectangle of node
+    WidgetPool::Handle makeButton(const std::string& text, UiLayout::Node node, UiCommand command, int zIndex, int fontSize) {
+        return widgets.create(text, layout.rect(node), command, zIndex, static_cast<int>(fontSize * getScaleFactor()));
+    }
 
-        difficultyButtons.push_back(std::make_unique<Button>("Hard", sf::Vector2f(startX + (buttonWidth + spacingX) * 2, startY), [this]() {
-            difficulty = HARD;
-            clickSound.play();
-            state = MENU;
-            updateButtonVisibility();
-            }, 3, buttonWidth, buttonHeight, static_cast<int>(22 * getScaleFactor())));
+    void createMenu(ButtonSet& buttons) {
+        buttons.push_back(makeButton("Play", ui.menu[0], UiCommand(UiCommand::START_GAME), 1, 24));
+        buttons.push_back(makeButton("Difficulty", ui.menu[1], UiCommand(UiCommand::SHOW_SCREEN, DIFFICULTY), 2, 24));
+        buttons.push_back(makeButton("Achievements", ui.menu[2], UiCommand(UiCommand::SHOW_SCREEN, ACHIEVEMENTS), 3, 24));
+        buttons.push_back(makeButton("Shop", ui.menu[3], UiCommand(UiCommand::SHOW_SCREEN, SHOP), 4, 24));
+        buttons.push_back(makeButton("Settings", ui.menu[4], UiCommand(UiCommand::SHOW_SCREEN, SETTINGS), 5, 24));
+        buttons.push_back(makeButton("Exit", ui.menu[5], UiCommand(UiCommand::QUIT), 6, 24));
+    }
 
-        // Second row - Expert, Master
-        float secondRowY = startY + buttonHeight + descOffset + spacingY;
-        difficultyButtons.push_back(std::make_unique<Button>("Expert", sf::Vector2f(startX + buttonWidth / 2, secondRowY), [this]() {
-            difficulty = EXPERT;
-            clickSound.play();
-            state = MENU;
-            updateButtonVisibility();
-            }, 4, buttonWidth, buttonHeight, static_cast<int>(22 * getScaleFactor())));
+    void createGameButtons(ButtonSet& gameButtons) {
+        gameButtons.push_back(makeButton("Restart", ui.game[0], UiCommand(UiCommand::START_GAME), 1, 24));
+        gameButtons.push_back(makeButton("Menu", ui.game[1], UiCommand(UiCommand::SHOW_SCREEN, MENU), 2, 24));
 
-        difficultyButtons.push_back(std::make_unique<Button>("Master", sf::Vector2f(startX + buttonWidth + spacingX + buttonWidth / 2, secondRowY), [this]() {
-            difficulty = MASTER;
-            clickSound.play();
-            state = MENU;
-            updateButtonVisibility();
-            }, 5, buttonWidth, buttonHeight, static_cast<int>(22 * getScaleFactor())));
-
-        // Back button
-        difficultyButtons.push_back(std::make_unique<Button>("Back", sf::Vector2f(window->getSize().x - buttonWidth - 30.f * getScaleFactor(),
-            window->getSize().y - buttonHeight - 30.f * getScaleFactor()), [this]() {
-                clickSound.play();
-                state = MENU;
-                updateButtonVisibility();
-            }, 6, buttonWidth, buttonHeight, static_cast<int>(22 * getScaleFactor())));
-    }
-
-    void createAchievementButtons() {
-        achievementButtons.clear();
-        float buttonWidth = 220.f * getScaleFactor();
-        float buttonHeight = 50.f * getScaleFactor();
-        float spacing = 30.f * getScaleFactor();
-
-        achievementButtons.push_back(std::make_unique<Button>("Back", sf::Vector2f(window->getSize().x - buttonWidth - spacing,
-            window->getSize().y - buttonHeight - spacing), [this]() {
-                clickSound.play();
-                state = MENU;
-                updateButtonVisibility();
-            }, 1, buttonWidth, buttonHeight, static_cast<int>(24 * getScaleFactor())));
-    }
-
-    void createShopButtons() {
-        shopButtons.clear();
-        float buttonWidth = 220.f * getScaleFactor();
-        float buttonHeight = 50.f * getScaleFactor();
-        float spacing = 30.f * getScaleFactor();
-
-        shopButtons.push_back(std::make_unique<Button>("Back", sf::Vector2f(window->getSize().x - buttonWidth - spacing,
-            window->getSize().y - buttonHeight - spacing), [this]() {
-                clickSound.play();
-                state = MENU;
-                updateButtonVisibility();
-            }, 1, buttonWidth, buttonHeight, static_cast<int>(24 * getScaleFactor())));
-    }
-
-    void createSettingsButtons() {
-        settingsButtons.clear();
-        float buttonWidth = 220.f * getScaleFactor();
-        float buttonHeight = 45.f * getScaleFactor();
-        float buttonX = window->getSize().x * 0.6f;
-        float startY = window->getSize().y * 0.3f;
-        float spacing = 25.f * getScaleFactor();
-
-        settingsButtons.push_back(std::make_unique<Button>("800x600", sf::Vector2f(buttonX, startY), [this]() {
-            clickSound.play();
-            config.width = 800;
-            config.height = 600;
-            config.fullscreen = false;
-            applySettings();
-            }, 1, buttonWidth, buttonHeight, static_cast<int>(20 * getScaleFactor())));
+        // Only shown once the game is decided
+        gameButtons.push_back(makeButton("Analysis", ui.game[2], UiCommand(UiCommand::OPEN_ANALYSIS), 3, 24));
+        analysisButton = gameButtons.back();
+    }
 
-        settingsButtons.push_back(std::make_unique<Button>("1024x768", sf::Vector2f(buttonX, startY + buttonHeight + spacing), [this]() {
-            clickSound.play();
-            config.width = 1024;
-            config.height = 768;
-            config.fullscreen = false;
-            applySettings();
-            }, 2, buttonWidth, buttonHeight, static_cast<int>(20 * getScaleFactor())));
+    void createDifficultyButtons(ButtonSet& difficultyButtons) {
+        for (int d = 0; d < DIFFICULTY_COUNT; ++d) {
+            difficultyButtons.push_back(makeButton(DIFFICULTY_RULES[d].name, ui.difficulty[d], UiCommand(UiCommand::SELECT_DIFFICULTY, d), d + 1, 22));
+        }
+        difficultyButtons.push_back(makeButton("Back", ui.difficultyBack, UiCommand(UiCommand::SHOW_SCREEN, MENU), DIFFICULTY_COUNT + 1, 22));
+    }
 
-        settingsButtons.push_back(std::make_unique<Button>("1280x720", sf::Vector2f(buttonX, startY + (buttonHeight + spacing) * 2), [this]() {
-            clickSound.play();
-            config.width = 1280;
-            config.height = 720;
-            config.fullscreen = false;
-            applySettings();
-            }, 3, buttonWidth, buttonHeight, static_cast<int>(20 * getScaleFactor())));
+    void createAchievementButtons(ButtonSet& achievementButtons) {
+        achievementButtons.push_back(makeButton("Back", ui.back, UiCommand(UiCommand::SHOW_SCREEN, MENU), 1, 24));
+    }
 
-        settingsButtons.push_back(std::make_unique<Button>("Fullscreen", sf::Vector2f(buttonX, startY + (buttonHeight + spacing) * 3), [this]() {
-            clickSound.play();
-            config.fullscreen = true;
-            applySettings();
-            }, 4, buttonWidth, buttonHeight, static_cast<int>(20 * getScaleFactor())));
+    void createShopButtons(ButtonSet& shopButtons) {
+        shopButtons.push_back(makeButton("Back", ui.back, UiCommand(UiCommand::SHOW_SCREEN, MENU), 1, 24));
+    }
 
-        settingsButtons.push_back(std::make_unique<Button>("Reset Progress", sf::Vector2f(buttonX, startY + (buttonHeight + spacing) * 4), [this]() {
-            clickSound.play();
-            resetProgress();
-            }, 5, buttonWidth, buttonHeight, static_cast<int>(20 * getScaleFactor())));
+    void createAnalysisButtons(ButtonSet& analysisButtons) {
+        analysisButtons.push_back(makeButton("Back", ui.back, UiCommand(UiCommand::CLOSE_ANALYSIS), 1, 24));
+    }
 
-        settingsButtons.push_back(std::make_unique<Button>("Back", sf::Vector2f(window->getSize().x - buttonWidth - 30.f * getScaleFactor(),
-            window->getSize().y - buttonHeight - 30.f * getScaleFactor()), [this]() {
-                clickSound.play();
-                state = MENU;
-                updateButtonVisibility();
-            }, 6, buttonWidth, buttonHeight, static_cast<int>(20 * getScaleFactor())));
+    void createSettingsButtons(ButtonSet& settingsButtons) {
+        settingsButtons.push_back(makeButton("800x600", ui.settings[0], UiCommand(UiCommand::SET_RESOLUTION, 800, 600), 1, 20));
+        settingsButtons.push_back(makeButton("1024x768", ui.settings[1], UiCommand(UiCommand::SET_RESOLUTION, 1024, 768), 2, 20));
+        settingsButtons.push_back(makeButton("1280x720", ui.settings[2], UiCommand(UiCommand::SET_RESOLUTION, 1280, 720), 3, 20));
+        settingsButtons.push_back(makeButton("Fullscreen", ui.settings[3], UiCommand(UiCommand::SET_FULLSCREEN), 4, 20));
+        settingsButtons.push_back(makeButton("Reset Progress", ui.settings[4], UiCommand(UiCommand::RESET_PROGRESS), 5, 20));
+        settingsButtons.push_back(makeButton("Next Profile", ui.profile, UiCommand(UiCommand::NEXT_PROFILE), 6, 20));
+        settingsButtons.push_back(makeButton("Back", ui.settingsBack, UiCommand(UiCommand::SHOW_SCREEN, MENU), 7, 20));
     }
 
     void resetProgress() {
@@ -681,6 +5156,7 @@ private:
             item.active = false;
             if (item.removeEffect) item.removeEffect();
         }
+        ++staticLayerVersion;
 
         // Reset game state
         showHintAfterWrongGuess = false;
@@ -692,24 +5168,68 @@ private:
         saveProgress();
     }
 
+    // Saves the current profile and loads the next one in the store, in
+    // creation order; profiles are created with --profile or in terminal mode
+    void switchToNextProfile() {
+        if (profileSlot < 0 || profiles.size() < 2) return;
+        saveProgress();
+        int slot = profiles.select(profiles.name((profileSlot + 1) % static_cast<int>(profiles.size())));
+        if (slot < 0) return;
+
+        // The old profile's perks must not carry over into the new one
+        for (auto& item : shopItems) {
+            if (item.active && item.removeEffect) item.removeEffect();
+        }
+        for (auto& a : achievements) a.justUnlocked = false;
+        profileSlot = slot;
+        loadProgress();
+        ++staticLayerVersion;
+    }
+
     void applySettings() {
+        TraceZone zone("applySettings");
         config.save();
         createWindow();
         updateBackgroundScale();
         updateTitlePosition();
+        ++staticLayerVersion;
 
-        // Recreate all buttons with new positions
+        // Screens are rebuilt with the new layout as they are entered
+        for (int id = 0; id < SCREEN_COUNT; ++id) releaseScreen(static_cast<ScreenId>(id));
         initGame();
         updateButtonVisibility();
     }
 
+    // Pauses the animations the current screen and quality level have no use for
+    void applyQuality() {
+        // The animated title is only drawn on the menu
+        TweenScheduler& tweens = TweenScheduler::instance();
+        bool animateTitle = state == MENU && QualityGovernor::animatesTitle(appliedQuality);
+        for (auto id : { titleScale, titleRotation, titleHue }) {
+            tweens.setPaused(id, !animateTitle);
+        }
+        tweens.setPaused(titleOutline, !animateTitle || !QualityGovernor::animatesTitleOutline(appliedQuality));
+
+        bool animateHover = QualityGovernor::animatesHover(appliedQuality);
+        for (const auto& slot : screens) {
+            if (!slot) continue;
+            for (WidgetPool::Handle btn : slot->buttons) widgets.setHoverAnimated(btn, animateHover);
+        }
+    }
+
     void updateButtonVisibility() {
-        for (auto& btn : buttons) btn->setVisible(state == MENU);
-        for (auto& btn : gameButtons) btn->setVisible(state == PLAYING || state == GAME_OVER);
-        for (auto& btn : difficultyButtons) btn->setVisible(state == DIFFICULTY);
-        for (auto& btn : achievementButtons) btn->setVisible(state == ACHIEVEMENTS);
-        for (auto& btn : shopButtons) btn->setVisible(state == SHOP);
-        for (auto& btn : settingsButtons) btn->setVisible(state == SETTINGS);
+        ScreenId current = screenFor(state);
+        ensureScreen(current).lastUsed = ++screenSwitches;
+        enforceScreenBudget(current);
+        applyQuality();
+
+        for (int id = 0; id < SCREEN_COUNT; ++id) {
+            if (!screens[id]) continue;
+            for (WidgetPool::Handle btn : screens[id]->buttons) widgets.setVisible(btn, id == current);
+        }
+        if (widgets.alive(analysisButton)) {
+            widgets.setVisible(analysisButton, (state == PLAYING || state == GAME_OVER) && (gameWon || gameLost));
+        }
     }
 
     void startNewGame() {
@@ -720,9 +5240,14 @@ private:
         attempts = 0;
         inputStr.clear();
         guessHistory.clear();
+        gameClues.clear();
+        gameAnalysis.clear();
         currentHint = "Make your guess!";
+        ++staticLayerVersion;
 
         timerActive = false;
+        gameStartTime = gameTime.now();
+        telemetry.gamesStarted[difficulty]->add();
 
         generateNumber();
         setupDifficultySettings();
@@ -743,43 +5268,120 @@ private:
             timeLimit += sf::seconds(30);
             timeRemaining = timeLimit;
         }
+
+        scheduleGameTimers();
     }
 
-    void setupDifficultySettings() {
-        switch (difficulty) {
-        case EASY:
-            range = 50;
-            maxAttempts = 0;
-            timerActive = false;
+    void scheduleGameTimers() {
+        cancelGameTimers();
+        if (!timerActive) return;
+
+        gameEndTime = gameStartTime + timeLimit;
+        deadlines.schedule(gameEndTime, GAME_TIMEOUT);
+        deadlines.schedule(gameEndTime - sf::seconds(30), LOW_TIME_WARNING);
+        deadlines.schedule(gameEndTime - sf::seconds(10), CRITICAL_TIME_WARNING);
+        deadlines.schedule(gameStartTime + sf::seconds(1), TIMER_SECOND_TICK);
+    }
+
+    void cancelGameTimers() {
+        for (int event : { GAME_TIMEOUT, LOW_TIME_WARNING, CRITICAL_TIME_WARNING, TIMER_SECOND_TICK, TIMER_BLINK }) {
+            deadlines.cancelEvent(event);
+        }
+        timerWarning = 0;
+        timerBlinkOn = false;
+    }
+
+    void onDeadline(int event) {
+        bool running = timerActive && state == PLAYING && !gameWon && !gameLost;
+
+        switch (event) {
+        case GAME_TIMEOUT:
+            if (!running) break;
+            timeRemaining = sf::Time::Zero;
+            timeUp = true;
+            gameLost = true;
+            sfx.play(SFX_LOSE);
+            state = GAME_OVER;
+            updateButtonVisibility();
+            cancelGameTimers();
+            finishGame();
             break;
-        case MEDIUM:
-            range = 100;
-            maxAttempts = 15;
-            timerActive = false;
+        case LOW_TIME_WARNING:
+            if (running) timerWarning = 1;
             break;
-        case HARD:
-            range = 200;
-            maxAttempts = 10;
-            timerActive = false;
+        case CRITICAL_TIME_WARNING:
+            if (!running) break;
+            timerWarning = 2;
+            deadlines.schedule(gameTime.now(), TIMER_BLINK);
             break;
-        case EXPERT:
-            range = 500;
-            maxAttempts = 7;
-            timeLimit = sf::seconds(120);
-            timeRemaining = timeLimit;
-            timerActive = true;
+        case TIMER_SECOND_TICK:
+            if (!running) break;
+            timeRemaining = gameEndTime - gameTime.now();
+            deadlines.schedule(gameTime.now() + sf::seconds(1), TIMER_SECOND_TICK);
             break;
-        case MASTER:
-            range = 1000;
-            maxAttempts = 5;
-            timeLimit = sf::seconds(60);
-            timeRemaining = timeLimit;
-            timerActive = true;
+        case TIMER_BLINK:
+            if (!running) break;
+            timerBlinkOn = !timerBlinkOn;
+            deadlines.schedule(gameTime.now() + sf::seconds(0.314f), TIMER_BLINK);
+            break;
+        case TOAST_EXPIRED:
+            for (auto& a : achievements) {
+                a.justUnlocked = false;
+            }
             break;
         }
+    }
+
+    static const std::vector<const char*>& playlistFor(MusicMood mood) {
+        static const std::vector<const char*> playlists[] = {
+            { "music-menu-calm.ogg" },
+            { "garmoniya-in-yan-278.mp3" },
+            { "music-tension.ogg" }
+        };
+        return playlists[mood];
+    }
+
+    // Tension music only plays on timed difficulties, once the 30 s warning fired
+    MusicMood musicMoodFor() const {
+        if (state == PLAYING && timerActive && timerWarning > 0) return TENSION_MUSIC;
+        if (state == PLAYING || state == GAME_OVER) return GAME_MUSIC;
+        return MENU_MUSIC;
+    }
+
+    void updateMusic() {
+        music.collectRetired();
+        MusicMood mood = musicMoodFor();
+        if (mood != musicMood) {
+            musicMood = mood;
+            musicTrack = 0;
+            musicStalled = !queueMusic(false);
+        }
+        else if (!musicStalled && !music.isSwitching() && music.secondsLeft() < MusicPlayer::CROSSFADE_SECONDS + 1.f) {
+            // Leaves the decoder a second to fill before the crossfade is due
+            musicStalled = !queueMusic(true);
+        }
+    }
+
+    // Queues the next playable track of the current playlist, or DEFAULT_MUSIC if it has none
+    bool queueMusic(bool atEnd) {
+        const std::vector<const char*>& tracks = playlistFor(musicMood);
+        for (std::size_t tried = 0; tried < tracks.size(); ++tried) {
+            std::string track = tracks[musicTrack++ % tracks.size()];
+            if (std::find(missingMusic.begin(), missingMusic.end(), track) != missingMusic.end()) continue;
+            if (music.queueTrack(RESOURCES_DIR + track, atEnd)) return true;
+            missingMusic.push_back(track);
+        }
+        return music.queueTrack(RESOURCES_DIR + DEFAULT_MUSIC, atEnd);
+    }
 
+    void setupDifficultySettings() {
+        const DifficultyRules& rules = DIFFICULTY_RULES[difficulty];
+        range = rules.range;
+        maxAttempts = rules.maxAttempts;
+        timerActive = rules.timeLimitSeconds > 0;
         if (timerActive) {
-            gameClock.restart();
+            timeLimit = sf::seconds(static_cast<float>(rules.timeLimitSeconds));
+            timeRemaining = timeLimit;
         }
     }
 
@@ -790,41 +5392,427 @@ private:
         secretNumber = distr(gen);
     }
 
-    void handleEvents() {
+    const sf::Time IDLE_POLL_INTERVAL = sf::milliseconds(10);
+
+    void runSingleThreaded() {
+        sf::Clock clock;
+        while (window->isOpen()) {
+            sf::Time deltaTime = clock.restart();
+            bool hadEvents = handleEvents();
+            if (!window->isOpen()) break;
+            sf::Time untilDeadline = deadlines.timeUntilNext(gameTime.now(), IDLE_POLL_INTERVAL + deltaTime);
+            if (!hadEvents && isIdle() && untilDeadline > deltaTime) {
+                // Nothing on screen changes before the next deadline or event: keep the
+                // last frame and sleep until then, polling input at least every 10 ms
+                gameTime.advance(deltaTime);
+                sf::sleep(std::min(untilDeadline - deltaTime, IDLE_POLL_INTERVAL));
+                continue;
+            }
+            update(deltaTime);
+            if (!applyWindowRequests()) break;
+            publishSnapshot();
+            snapshots.fetch();
+            render(snapshots.readBuffer());
+        }
+    }
+
+    // The main thread owns the window: it polls events, forwards them to the
+    // logic thread and draws whatever snapshot was published last
+    void runThreaded() {
+        startLogicThread();
+        while (window->isOpen()) {
+            sf::Event event;
+            while (window->pollEvent(event)) {
+                if (event.type == sf::Event::Closed) {
+                    stopLogicThread();
+                    saveProgress();
+                    window->close();
+                    break;
+                }
+                if (!inputQueue.push(stampEvent(event))) {
+                    std::cerr << "Warning: input queue full, dropping event" << std::endl;
+                }
+            }
+            if (!window->isOpen()) break;
+            if (soakMonitor) driveSoak();
+
+            if (closeRequested || settingsRequested) {
+                // Both need the window, so the logic thread is parked while they run
+                stopLogicThread();
+                if (!applyWindowRequests()) break;
+                publishSnapshot();
+                startLogicThread();
+            }
+
+            bool fresh = snapshots.fetch();
+            if (!fresh && particles.getAliveCount() == 0) {
+                sf::sleep(sf::milliseconds(1));
+                continue;
+            }
+            render(snapshots.readBuffer());
+        }
+        stopLogicThread();
+    }
+
+    void startLogicThread() {
+        if (logicRunning) return;
+        logicRunning = true;
+        logicThread = std::thread(&NumberGuesser::logicLoop, this);
+    }
+
+    void stopLogicThread() {
+        logicRunning = false;
+        if (logicThread.joinable()) logicThread.join();
+    }
+
+    void logicLoop() {
+        Tracer::nameThread("logic");
+        const sf::Time tick = sf::seconds(1.f / 120.f);
+        sf::Clock clock;
+        sf::Time lag;
+
+        while (logicRunning) {
+            TimedEvent timed;
+            while (inputQueue.pop(timed)) {
+                processEvent(timed);
+            }
+
+            lag += clock.restart();
+            // Catch up after a stall, but never spiral: drop whatever is left over
+            int steps = 0;
+            while (lag >= tick && steps < 8) {
+                update(tick);
+                lag -= tick;
+                ++steps;
+            }
+            if (steps == 8) lag = sf::Time::Zero;
+
+            publishSnapshot();
+
+            sf::Time spent = clock.getElapsedTime() + lag;
+            if (spent < tick) sf::sleep(tick - spent);
+        }
+    }
+
+    // Runs requests that recreate or close the window; returns false once it is closed
+    bool applyWindowRequests() {
+        if (closeRequested) {
+            closeRequested = false;
+            window->close();
+            return false;
+        }
+        if (settingsRequested) {
+            settingsRequested = false;
+            applySettings();
+        }
+        return true;
+    }
+
+    // Only deadlines can change the screen; the game timer no longer needs frames of its own
+    bool isIdle() const {
+        return TweenScheduler::instance().isSettled() && particles.getAliveCount() == 0;
+    }
+
+    bool handleEvents() {
+        TraceZone zone("handleEvents");
+        bool hadEvents = false;
         sf::Event event;
         while (window->pollEvent(event)) {
+            hadEvents = true;
             if (event.type == sf::Event::Closed) {
                 saveProgress();
                 window->close();
+                return true;
             }
+            processEvent(stampEvent(event));
+        }
+        if (soakMonitor && driveSoak()) hadEvents = true;
+        return hadEvents;
+    }
+
+    void startSoak() {
+        soakMonitor = std::make_unique<SoakMonitor>(SOAK_REPORT_FILE, options.soakTolerance);
+        soak.restore = config;
+        soak.started = nowMicros();
+        soak.lastMenuStep = soak.lastResolutionSwitch = soak.started;
+        soak.sampleInterval = std::max<sf::Int64>(1000000, static_cast<sf::Int64>(options.soakMinutes * 60e6 / SOAK_SAMPLES));
+        soak.nextSample = soak.started + soak.sampleInterval;
+    }
+
+    void finishSoak() {
+        soakMonitor->sample((nowMicros() - soak.started) / 60e6, textureCount());
+        double warmup = options.soakMinutes / 10;
+        if (warmup < SOAK_WARMUP_MINUTES) warmup = SOAK_WARMUP_MINUTES;
+        soakDrifted = !soakMonitor->check(warmup, std::cout);
+        std::cout << "soak script: " << soak.games << " games, " << soak.menuStep << " menu steps, "
+            << soak.resolutionSwitches << " resolution switches" << (soak.stalled ? "  STALLED" : "") << std::endl;
+        config = soak.restore;
+        config.save();
+    }
 
-            if (state == PLAYING && event.type == sf::Event::TextEntered) {
-                handleInput(event.text.unicode);
+    // Textures alive in the process: the shared resources plus this game's render targets
+    std::size_t textureCount() const {
+        std::size_t count = ResourceManager::textureCount();
+        if (staticLayer.getSize().x > 0) ++count;
+        if (offscreenTarget.getSize().x > 0) ++count;
+        return count;
+    }
+
+    // Plays through the same events a player produces, one action every
+    // SOAK_ACTION_MICROS: start games and guess, pick difficulties, open the
+    // analysis, toggle shop items and switch resolutions. Actions are chosen
+    // from the last published snapshot, so in threaded mode this stays on the
+    // main thread with the window. Returns true when it injected input.
+    bool driveSoak() {
+        sf::Int64 now = nowMicros();
+        if (now >= soak.nextSample) {
+            soak.nextSample += soak.sampleInterval;
+            soakMonitor->sample((now - soak.started) / 60e6, textureCount());
+        }
+        if (now - soak.started >= static_cast<sf::Int64>(options.soakMinutes * 60e6)) {
+            closeRequested = true;
+            return false;
+        }
+        if (now < soak.nextAction) return false;
+        soak.nextAction = now + SOAK_ACTION_MICROS;
+
+        const RenderSnapshot& snap = snapshots.readBuffer();
+        // A screen the script cannot leave would pass the drift check while
+        // exercising nothing; a resolution switch comes once per menu round
+        if (!soak.stalled && (now - soak.lastMenuStep > SOAK_STALL_MICROS
+            || now - soak.lastResolutionSwitch > SOAK_STALL_MICROS * (MENU_BUTTONS - 1))) {
+            std::cout << "soak: script made no progress on screen " << snap.state << " at "
+                << std::fixed << std::setprecision(1) << (now - soak.started) / 60e6 << " min" << std::endl;
+            soak.stalled = true;
+        }
+        int round = soak.menuStep / (MENU_BUTTONS - 1);
+        switch (snap.state) {
+        case MENU: {
+            // Every entry but Exit, in turn
+            int entry = soak.menuStep++ % (MENU_BUTTONS - 1);
+            soak.lastMenuStep = now;
+            if (entry == 0) {
+                ++soak.games;
+                soak.low = 1;
+                soak.high = 0;
+                soak.analysisSeen = false;
+            }
+            soak.resized = false;
+            soak.shopClicks = 0;
+            injectClick(ui.menu[entry]);
+            break;
+        }
+        case DIFFICULTY:
+            injectClick(ui.difficulty[round % DIFFICULTY_COUNT]);
+            break;
+        case PLAYING: {
+            // A won game stays on this screen; leave it the way GAME_OVER is left
+            if (snap.gameWon) {
+                injectClick(soak.analysisSeen ? ui.game[1] : ui.game[2]);
+                soak.analysisSeen = true;
+                break;
+            }
+            // Every other game bisects towards the secret and wins, the rest guess at random
+            if (soak.high == 0) soak.high = snap.range;
+            int guess = soak.games % 2 ? 1 + std::rand() % snap.range : (soak.low + soak.high) / 2;
+            if (guess < snap.secretNumber) soak.low = guess + 1;
+            else if (guess > snap.secretNumber) soak.high = guess - 1;
+            for (std::size_t i = 0; i < snap.inputStr.size(); ++i) injectText('\b');
+            for (char digit : std::to_string(guess)) injectText(static_cast<sf::Uint32>(digit));
+            injectText('\r');
+            break;
+        }
+        case GAME_OVER:
+            injectClick(soak.analysisSeen ? ui.game[1] : ui.game[2]);
+            soak.analysisSeen = true;
+            break;
+        case SHOP:
+            if (soak.shopClicks < shopItems.size()) {
+                sf::FloatRect itemButton = shopItemButtonRect(soak.shopClicks++);
+                if (itemButton.width > 0) injectClick(itemButton);
+            }
+            else {
+                injectClick(ui.back);
+            }
+            break;
+        case SETTINGS:
+            // Three windowed presets in turn; fullscreen and reset are left alone
+            if (soak.resized) {
+                injectClick(ui.settingsBack);
+                break;
             }
+            injectClick(ui.settings[round % 3]);
+            soak.resized = true;
+            ++soak.resolutionSwitches;
+            soak.lastResolutionSwitch = now;
+            break;
+        case ACHIEVEMENTS:
+        case ANALYSIS:
+            injectClick(ui.back);
+            break;
+        }
+        return true;
+    }
 
-            if (state == PLAYING && event.type == sf::Event::KeyPressed) {
-                if (event.key.code == sf::Keyboard::Escape) {
-                    clickSound.play();
-                    state = MENU;
-                    updateButtonVisibility();
-                }
-                else if (event.key.code == sf::Keyboard::R) {
-                    clickSound.play();
-                    startNewGame();
-                }
+    void injectClick(UiLayout::Node node) {
+        injectClick(layout.rect(node));
+    }
+
+    void injectClick(const sf::FloatRect& rect) {
+        sf::Event event;
+        event.type = sf::Event::MouseButtonPressed;
+        event.mouseButton.button = sf::Mouse::Left;
+        event.mouseButton.x = static_cast<int>(rect.left + rect.width / 2);
+        event.mouseButton.y = static_cast<int>(rect.top + rect.height / 2);
+        injectEvent(event);
+    }
+
+    void injectText(sf::Uint32 code) {
+        sf::Event event;
+        event.type = sf::Event::TextEntered;
+        event.text.unicode = code;
+        injectEvent(event);
+    }
+
+    // Main thread only, as it reads the window
+    WindowInput captureWindow() const {
+        WindowInput input;
+        input.pointer = sf::Mouse::getPosition(*window);
+        input.size = window->getSize();
+        input.view = window->getView();
+        return input;
+    }
+
+    TimedEvent stampEvent(const sf::Event& event) const {
+        TimedEvent timed;
+        timed.event = event;
+        timed.stamp = nowMicros();
+        timed.window = captureWindow();
+        return timed;
+    }
+
+    void injectEvent(const sf::Event& event) {
+        TimedEvent timed = stampEvent(event);
+        if (!options.threaded) {
+            processEvent(timed);
+            return;
+        }
+        if (!inputQueue.push(timed)) {
+            std::cerr << "Warning: input queue full, dropping event" << std::endl;
+        }
+    }
+
+    void processEvent(const TimedEvent& timed) {
+        const sf::Event& event = timed.event;
+        const sf::Int64 stamp = timed.stamp;
+        windowInput = timed.window;
+        lastInputStamp = std::max(lastInputStamp, stamp);
+
+        if (state == PLAYING && event.type == sf::Event::TextEntered) {
+            handleInput(event.text.unicode);
+        }
+
+        if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F9 && !options.traceFile.empty()) {
+            Tracer::setEnabled(!Tracer::enabled());
+        }
+
+        if (state == PLAYING && event.type == sf::Event::KeyPressed) {
+            UiCommand command;
+            if (event.key.code == sf::Keyboard::Escape) {
+                command = UiCommand(UiCommand::SHOW_SCREEN, MENU);
             }
+            else if (event.key.code == sf::Keyboard::R) {
+                command = UiCommand(UiCommand::START_GAME);
+            }
+            if (command.type != UiCommand::NONE) {
+                command.stamp = stamp;
+                uiCommands.push(command);
+            }
+        }
 
-            if (state == SHOP && event.type == sf::Event::MouseButtonPressed) {
-                if (event.mouseButton.button == sf::Mouse::Left) {
-                    shopButtonPressed = true;
-                }
+        // Queued rather than polled in update, so a tap that is released
+        // before the next frame still registers, with its real timestamp
+        if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left) {
+            PointerPress press;
+            press.position = sf::Vector2i(event.mouseButton.x, event.mouseButton.y);
+            press.point = windowInput.mapPixelToCoords(press.position);
+            press.stamp = stamp;
+            if (!pendingPresses.push(press)) {
+                std::cerr << "Warning: press queue full, dropping click" << std::endl;
             }
-            else if (state == SHOP && event.type == sf::Event::MouseButtonReleased) {
-                if (event.mouseButton.button == sf::Mouse::Left) {
-                    shopButtonPressed = false;
-                }
+        }
+    }
+
+    void requestEffect(EffectRequest::Kind kind, sf::FloatRect area, int count) {
+        EffectRequest& request = effectRing[effectSequence % EFFECT_RING_SIZE];
+        request.kind = kind;
+        request.area = area;
+        request.count = count;
+        ++effectSequence;
+    }
+
+    void publishSnapshot() {
+        const TweenScheduler& tweens = TweenScheduler::instance();
+        RenderSnapshot& snap = snapshots.writeBuffer();
+
+        snap.state = state;
+        snap.difficulty = difficulty;
+        snap.attempts = attempts;
+        snap.maxAttempts = maxAttempts;
+        snap.range = range;
+        snap.secretNumber = secretNumber;
+        snap.totalPoints = totalPoints;
+        snap.gameWon = gameWon;
+        snap.timeUp = timeUp;
+        snap.timerActive = timerActive;
+        snap.timeRemaining = timeRemaining;
+        snap.timerWarning = timerWarning;
+        snap.timerBlinkOn = timerBlinkOn;
+        snap.inputStr = inputStr;
+        snap.currentHint = currentHint;
+        snap.inputColor = inputColor;
+        snap.guessHistory = guessHistory;
+        snap.analysis = gameAnalysis;
+
+        snap.achievementUnlocked.resize(achievements.size());
+        snap.toastAchievement = -1;
+        for (std::size_t i = 0; i < achievements.size(); ++i) {
+            snap.achievementUnlocked[i] = achievements[i].unlocked;
+            if (achievements[i].justUnlocked && snap.toastAchievement < 0) {
+                snap.toastAchievement = static_cast<int>(i);
             }
         }
+        snap.toastAlpha = tweens.value(toastAlpha);
+
+        snap.shopPurchased.resize(shopItems.size());
+        snap.shopActive.resize(shopItems.size());
+        for (std::size_t i = 0; i < shopItems.size(); ++i) {
+            snap.shopPurchased[i] = shopItems[i].purchased;
+            snap.shopActive[i] = shopItems[i].active;
+        }
+        if (profileSlot >= 0) snap.profileName = profiles.name(profileSlot);
+        else snap.profileName.clear();
+
+        snap.titleScale = tweens.value(titleScale);
+        snap.titleRotation = tweens.value(titleRotation);
+        snap.titleOutline = tweens.value(titleOutline);
+        snap.titleColor = titleColor;
+
+        const Screen& visible = ensureScreen(screenFor(state));
+        snap.screen = &visible;
+        snap.buttonVisuals.resize(visible.buttons.size());
+        for (std::size_t i = 0; i < visible.buttons.size(); ++i) {
+            snap.buttonVisuals[i] = widgets.visual(visible.buttons[i]);
+        }
+        snap.sequence = ++publishedSnapshots;
+
+        snap.staticLayerVersion = staticLayerVersion;
+        snap.effects = effectRing;
+        snap.effectSequence = effectSequence;
+        snap.inputStamp = lastInputStamp;
+        snap.commandStamp = lastCommandStamp;
+
+        snapshots.publish();
     }
 
     void handleInput(sf::Uint32 code) {
@@ -847,6 +5835,7 @@ private:
             if (guess < 1 || guess > range) return;
 
             attempts++;
+            FlightRecorder::get().record(FlightRecorder::GUESS, DIFFICULTY_RULES[difficulty].name, guess, attempts);
             updateTemperature(guess);
 
             //   
@@ -854,46 +5843,46 @@ private:
 
             //  /,   
             if (showEvenOdd && guess != secretNumber) {
-                fullHint += " (" + std::string(secretNumber % 2 == 0 ? "Even" : "Odd") + ")";
+                fullHint += parityHint(secretNumber);
             }
 
             //  ,   
             if (showHintAfterWrongGuess && guess != secretNumber) {
-                fullHint += " (" + std::string(guess < secretNumber ? "Higher" : "Lower") + ")";
+                fullHint += directionHint(guess, secretNumber);
             }
 
             guessHistory.emplace_back(guess, fullHint, inputColor);
+            trimGuessHistory();
+            gameClues.push_back({ guess, showEvenOdd, showHintAfterWrongGuess });
 
             if (guess == secretNumber) {
                 gameWon = true;
-                winSound.play();
+                sfx.play(SFX_WIN);
+                if (timerActive) {
+                    timeRemaining = gameEndTime - gameTime.now();
+                    cancelGameTimers();
+                }
+                finishGame();
+                requestEffect(EffectRequest::CONFETTI, sf::FloatRect(0.f, 0.f,
+                    static_cast<float>(windowInput.size.x), static_cast<float>(windowInput.size.y)), 1500);
                 if (attempts < bestScore) bestScore = attempts;
 
-                switch (difficulty) {
-                case EASY: totalPoints += 10; break;
-                case MEDIUM: totalPoints += 25; break;
-                case HARD: totalPoints += 50; break;
-                case EXPERT: totalPoints += 100; break;
-                case MASTER: totalPoints += 200; break;
-                }
+                totalPoints += DIFFICULTY_RULES[difficulty].points;
 
-                checkAchievements();
                 checkWinAchievements();
             }
             else if ((maxAttempts > 0 && attempts >= maxAttempts) || timeUp) {
                 gameLost = true;
-                loseSound.play();
+                sfx.play(SFX_LOSE);
                 state = GAME_OVER;
-                updateButtonVisibility();
+                finishGame();
                 checkLoseAchievements();
             }
 
             inputStr.clear();
 
             if (showRangeAfterFewAttempts && attempts >= 3 && !gameWon && !gameLost) {
-                int lower = std::max(1, secretNumber - range / 10);
-                int upper = std::min(range, secretNumber + range / 10);
-                currentHint = "Range: " + std::to_string(lower) + "-" + std::to_string(upper);
+                currentHint = revealedRange(secretNumber, range);
             }
         }
         catch (...) {
@@ -902,76 +5891,50 @@ private:
     }
 
     void updateTemperature(int guess) {
-        float diff = std::abs(guess - secretNumber) / static_cast<float>(range);
-
-        if (diff < 0.05f) {
+        switch (evaluateGuess(difficulty, guess, secretNumber).band) {
+        case 0:
             currentHint = "BOILING HOT!";
             inputColor = sf::Color(255, 0, 0);
-        }
-        else if (diff < 0.1f) {
+            requestEffect(EffectRequest::EMBERS, layout.rect(ui.inputBox), 200);
+            break;
+        case 1:
             currentHint = "Very Hot";
             inputColor = sf::Color(255, 50, 0);
-        }
-        else if (diff < 0.2f) {
+            break;
+        case 2:
             currentHint = "Hot";
             inputColor = sf::Color(255, 100, 0);
-        }
-        else if (diff < 0.3f) {
+            break;
+        case 3:
             currentHint = "Warm";
             inputColor = sf::Color(255, 165, 0);
-        }
-        else if (diff < 0.4f) {
+            break;
+        case 4:
             currentHint = "Cool";
             inputColor = sf::Color(255, 255, 0);
-        }
-        else if (diff < 0.6f) {
+            break;
+        case 5:
             currentHint = "Cold";
             inputColor = sf::Color(100, 100, 255);
-        }
-        else {
+            break;
+        default:
             currentHint = "FREEZING!";
             inputColor = sf::Color(0, 0, 255);
-            unlockAchievement(10);
+            unlockAchievement(FREEZING_ACHIEVEMENT);
+            break;
         }
     }
 
-    void checkAchievements() {
-        if (attempts == 1) unlockAchievement(2);
-        if (attempts <= 5) unlockAchievement(1);
-        if (!achievements[0].unlocked) unlockAchievement(0);
-
-        if (attempts >= 10) unlockAchievement(7);
-        if (maxAttempts > 0 && attempts == maxAttempts - 1) unlockAchievement(8);
-    }
-
     void checkWinAchievements() {
-        if (timerActive && (difficulty == EXPERT || difficulty == MASTER) &&
-            timeRemaining > sf::Time::Zero) {
-            unlockAchievement(3);
-        }
-
-        if (difficulty == MASTER) {
-            unlockAchievement(4);
-        }
-
-        if (timerActive && gameClock.getElapsedTime().asSeconds() < 30) {
-            unlockAchievement(9);
-        }
-
-        bool allDifficulties = true;
-        for (int i = 0; i <= MASTER; ++i) {
-            allDifficulties = allDifficulties && (i == difficulty);
+        WonGame game = { difficulty, attempts, maxAttempts, timerActive, timeRemaining > sf::Time::Zero,
+            (gameTime.now() - gameStartTime).asSeconds() };
+        for (int index : winAchievements(game)) {
+            unlockAchievement(index);
         }
-        if (allDifficulties) unlockAchievement(6);
 
-        bool allUnlocked = true;
-        for (const auto& a : achievements) {
-            if (!a.unlocked && a.title != "Completionist") {
-                allUnlocked = false;
-                break;
-            }
+        if (completionistEarned([this](int i) { return achievements[i].unlocked; })) {
+            unlockAchievement(COMPLETIONIST_ACHIEVEMENT);
         }
-        if (allUnlocked) unlockAchievement(11);
     }
 
     void checkLoseAchievements() {
@@ -982,51 +5945,78 @@ private:
         if (!achievements[idx].unlocked) {
             achievements[idx].unlocked = true;
             achievements[idx].justUnlocked = true;
+            ++staticLayerVersion;
             lastUnlockedAchievement = achievements[idx].title;
-            achievementDisplayClock.restart();
+            // Hold fully visible for 2.5 s, then fade out over 0.5 s
+            TweenScheduler::instance().set(toastAlpha, 255.f);
+            TweenScheduler::instance().animateTo(toastAlpha, 0.f, 0.5f, Ease::Linear, 2.5f);
+            deadlines.cancelEvent(TOAST_EXPIRED);
+            deadlines.schedule(gameTime.now() + sf::seconds(3), TOAST_EXPIRED);
+            const sf::FloatRect& toast = layout.rect(ui.toast);
+            requestEffect(EffectRequest::SPARKS, sf::FloatRect(toast.left + toast.width / 2, toast.top + toast.height / 2, 0.f, 0.f), 300);
             saveProgress();
         }
     }
 
-    void saveProgress() {
-        std::ofstream file(SAVE_FILE);
-        if (file) {
-            file << bestScore << "\n";
-            file << totalPoints << "\n";
-            for (const auto& a : achievements) {
-                file << a.unlocked << " ";
-            }
-            file << "\n";
-            for (const auto& item : shopItems) {
-                file << item.purchased << " " << item.active << " ";
-            }
+    // Runs once when a game is won or lost
+    void finishGame() {
+        recordGameEnd();
+        gameAnalysis = GameAnalyzer(range, secretNumber).analyze(gameClues);
+        ++staticLayerVersion;
+        updateButtonVisibility();
+    }
+
+    void recordGameEnd() {
+        telemetry.guessesPerGame->observe(attempts);
+        if (gameWon) {
+            telemetry.gamesWon[difficulty]->add();
+            telemetry.timeToWin->observe((gameTime.now() - gameStartTime).asMicroseconds());
+        }
+        else {
+            telemetry.gamesLost[difficulty]->add();
         }
     }
 
-    void loadProgress() {
-        std::ifstream file(SAVE_FILE);
-        if (file) {
-            file >> bestScore;
-            file >> totalPoints;
-            for (auto& a : achievements) {
-                bool unlocked;
-                if (file >> unlocked) a.unlocked = unlocked;
-            }
-            for (auto& item : shopItems) {
-                bool purchased, active;
-                if (file >> purchased >> active) {
-                    item.purchased = purchased;
-                    item.active = active;
-                    if (active && item.applyEffect) {
-                        item.applyEffect();
-                    }
-                }
+    void saveProgress() {
+        TraceZone zone("saveProgress");
+        ScopedMetricTimer timer(telemetry.saveLatency, FlightRecorder::SAVE, "profiles.dat");
+        SaveData data;
+        data.bestScore = bestScore;
+        data.totalPoints = totalPoints;
+        for (int i = 0; i < ACHIEVEMENT_COUNT; ++i) {
+            data.achievements[i] = achievements[i].unlocked;
+        }
+        for (int i = 0; i < SHOP_ITEM_COUNT; ++i) {
+            data.purchased[i] = shopItems[i].purchased;
+            data.active[i] = shopItems[i].active;
+        }
+        profiles.write(profileSlot, data);
+    }
+
+    void loadProgress() {
+        TraceZone zone("loadProgress");
+        SaveData data;
+        data.bestScore = bestScore;
+        data.totalPoints = totalPoints;
+        if (!profiles.read(profileSlot, data)) return;
+
+        bestScore = data.bestScore;
+        totalPoints = data.totalPoints;
+        for (int i = 0; i < ACHIEVEMENT_COUNT; ++i) {
+            achievements[i].unlocked = data.achievements[i];
+        }
+        for (int i = 0; i < SHOP_ITEM_COUNT; ++i) {
+            shopItems[i].purchased = data.purchased[i];
+            shopItems[i].active = data.active[i];
+            if (data.active[i] && shopItems[i].applyEffect) {
+                shopItems[i].applyEffect();
             }
         }
     }
 
     void purchaseItem(int index) {
         if (index < 0 || index >= static_cast<int>(shopItems.size())) return;
+        ++staticLayerVersion;
         if (!shopItems[index].purchased && totalPoints >= shopItems[index].cost) {
             totalPoints -= shopItems[index].cost;
             shopItems[index].purchased = true;
@@ -1069,139 +6059,241 @@ private:
     }
 
     void update(sf::Time deltaTime) {
-        float elapsed = titleAnimationClock.getElapsedTime().asSeconds();
+        TraceZone zone("update");
+        collectRetiredScreens();
+        updateMusic();
+
+        QualityGovernor::Level quality = static_cast<QualityGovernor::Level>(qualityLevel.load(std::memory_order_relaxed));
+        if (quality != appliedQuality) {
+            appliedQuality = quality;
+            applyQuality();
+        }
+
+        gameTime.advance(deltaTime);
+        deadlines.fireDue(gameTime.now(), [this](int event) { onDeadline(event); });
+
         float delta = deltaTime.asSeconds();
+        TweenScheduler& tweens = TweenScheduler::instance();
+        tweens.update(delta);
 
         //      
-        if (titleGrowing) {
-            titleScale += delta * 0.3f;
-            if (titleScale >= 1.1f) titleGrowing = false;
-        }
-        else {
-            titleScale -= delta * 0.3f;
-            if (titleScale <= 0.9f) titleGrowing = true;
+        if (state == MENU) {
+            titleColor = hslToRgb(tweens.value(titleHue), 0.8f, 0.7f);
         }
 
-        titleRotation = 3.0f * std::sin(elapsed * 1.5f);
-        colorHue = std::fmod(elapsed * 45.0f, 360.0f);
-        titleColor = hslToRgb(colorHue, 0.8f, 0.7f);
 
-        if (outlineGrowing) {
-            outlineThickness += delta * 0.8f;
-            if (outlineThickness >= 3.f) outlineGrowing = false;
+        // One press per update, so a click never acts on the screen it opens;
+        // presses that arrive together wait for the following updates
+        bool anyButtonPressed = false;
+        PointerPress pendingPress;
+        const PointerPress* press = pendingPresses.pop(pendingPress) ? &pendingPress : nullptr;
+
+        sf::Vector2i mouse = windowInput.pointer;
+        auto updateButtons = [&](const ButtonSet& buttons, bool allowInteraction) {
+            if (widgets.update(buttons.data(), buttons.size(), mouse, anyButtonPressed ? nullptr : press, allowInteraction, uiCommands)) {
+                anyButtonPressed = true;
+            }
+            };
+
+        // The current screen takes the press; the others only finish their hover animations
+        ScreenId current = screenFor(state);
+        updateButtons(ensureScreen(current).buttons, true);
+        for (int id = 0; id < SCREEN_COUNT; ++id) {
+            if (id != current && screens[id]) updateButtons(screens[id]->buttons, false);
         }
-        else {
-            outlineThickness -= delta * 0.8f;
-            if (outlineThickness <= 1.f) outlineGrowing = true;
+
+        if (!anyButtonPressed) {
+            updateShop(press);
         }
 
-        if (timerActive && state == PLAYING && !gameWon && !gameLost) {
-            timeRemaining = timeLimit - gameClock.getElapsedTime();
-            if (timeRemaining <= sf::Time::Zero) {
-                timeUp = true;
-                gameLost = true;
-                loseSound.play();
-                state = GAME_OVER;
-                updateButtonVisibility();
-            }
+        // State transitions happen here and nowhere else in the update pass
+        UiCommand command;
+        while (uiCommands.pop(command)) {
+            executeCommand(command);
         }
 
-        bool anyButtonPressed = false;
-        buttonPressedThisFrame = false;
+        if (state != recordedState) {
+            static const char* names[] = { "menu", "playing", "achievements", "difficulty", "game over", "shop", "settings", "analysis" };
+            FlightRecorder::get().record(FlightRecorder::STATE, names[state], recordedState, state);
+            recordedState = state;
+        }
+    }
 
-        auto updateButtons = [&](std::vector<std::unique_ptr<Button>>& buttons, bool allowInteraction) {
-            for (auto& btn : buttons) {
-                btn->update(*window, deltaTime, buttonPressedThisFrame, allowInteraction);
-                if (btn->wasPressedThisFrame()) {
-                    anyButtonPressed = true;
-                }
-            }
-            };
+    void executeCommand(const UiCommand& command) {
+        if (command.stamp > 0) {
+            telemetry.inputToCommand->observe(nowMicros() - command.stamp);
+            lastCommandStamp = std::max(lastCommandStamp, command.stamp);
+        }
+        FlightRecorder::get().record(FlightRecorder::COMMAND, UiCommand::name(command.type), command.value, command.extra);
+        if (command.type != UiCommand::QUIT && command.type != UiCommand::PURCHASE_ITEM) {
+            sfx.play(SFX_CLICK);
+        }
 
-        switch (state) {
-        case MENU:
-            updateButtons(buttons, true);
-            updateButtons(gameButtons, false);
-            updateButtons(difficultyButtons, false);
-            updateButtons(achievementButtons, false);
-            updateButtons(shopButtons, false);
-            updateButtons(settingsButtons, false);
+        switch (command.type) {
+        case UiCommand::START_GAME:
+            startNewGame();
             break;
-        case PLAYING:
-        case GAME_OVER:
-            updateButtons(gameButtons, true);
-            updateButtons(buttons, false);
-            updateButtons(difficultyButtons, false);
-            updateButtons(achievementButtons, false);
-            updateButtons(shopButtons, false);
-            updateButtons(settingsButtons, false);
+        case UiCommand::SHOW_SCREEN:
+            state = static_cast<GameState>(command.value);
+            updateButtonVisibility();
             break;
-        case DIFFICULTY:
-            updateButtons(difficultyButtons, true);
-            updateButtons(buttons, false);
-            updateButtons(gameButtons, false);
-            updateButtons(achievementButtons, false);
-            updateButtons(shopButtons, false);
-            updateButtons(settingsButtons, false);
+        case UiCommand::SELECT_DIFFICULTY:
+            difficulty = static_cast<Difficulty>(command.value);
+            state = MENU;
+            updateButtonVisibility();
             break;
-        case ACHIEVEMENTS:
-            updateButtons(achievementButtons, true);
-            updateButtons(buttons, false);
-            updateButtons(gameButtons, false);
-            updateButtons(difficultyButtons, false);
-            updateButtons(shopButtons, false);
-            updateButtons(settingsButtons, false);
+        case UiCommand::OPEN_ANALYSIS:
+            analysisReturnState = state;
+            state = ANALYSIS;
+            updateButtonVisibility();
             break;
-        case SHOP:
-            updateButtons(shopButtons, true);
-            updateButtons(buttons, false);
-            updateButtons(gameButtons, false);
-            updateButtons(difficultyButtons, false);
-            updateButtons(achievementButtons, false);
-            updateButtons(settingsButtons, false);
+        case UiCommand::CLOSE_ANALYSIS:
+            state = analysisReturnState;
+            updateButtonVisibility();
             break;
-        case SETTINGS:
-            updateButtons(settingsButtons, true);
-            updateButtons(buttons, false);
-            updateButtons(gameButtons, false);
-            updateButtons(difficultyButtons, false);
-            updateButtons(achievementButtons, false);
-            updateButtons(shopButtons, false);
+        case UiCommand::SET_RESOLUTION:
+            config.width = command.value;
+            config.height = command.extra;
+            config.fullscreen = false;
+            settingsRequested = true;
+            break;
+        case UiCommand::SET_FULLSCREEN:
+            config.fullscreen = true;
+            settingsRequested = true;
+            break;
+        case UiCommand::RESET_PROGRESS:
+            resetProgress();
+            break;
+        case UiCommand::PURCHASE_ITEM:
+            purchaseItem(command.value);
+            break;
+        case UiCommand::NEXT_PROFILE:
+            switchToNextProfile();
+            break;
+        case UiCommand::QUIT:
+            closeRequested = true;
+            break;
+        case UiCommand::NONE:
             break;
         }
+    }
+
+    bool shopRowShown(std::size_t index) const {
+        if (index >= SHOP_ITEM_COUNT) return false;
+        const sf::FloatRect& row = layout.rect(ui.shopRows[index]);
+        const sf::FloatRect& area = layout.rect(ui.shopArea);
+        return row.top + row.height <= area.top + area.height;
+    }
+
+    // Shop item buttons are plain rectangles rather than pooled widgets
+    sf::FloatRect shopItemButtonRect(std::size_t index) const {
+        return shopRowShown(index) ? layout.rect(ui.shopBuy[index]) : sf::FloatRect();
+    }
 
-        if (anyButtonPressed) {
-            auto resetButtons = [](std::vector<std::unique_ptr<Button>>& buttons) {
-                for (auto& btn : buttons) btn->resetPressState();
-                };
+    void updateShop(const PointerPress* press) {
+        if (state != SHOP || !press) return;
 
-            switch (state) {
-            case MENU: resetButtons(buttons); break;
-            case PLAYING:
-            case GAME_OVER: resetButtons(gameButtons); break;
-            case DIFFICULTY: resetButtons(difficultyButtons); break;
-            case ACHIEVEMENTS: resetButtons(achievementButtons); break;
-            case SHOP: resetButtons(shopButtons); break;
-            case SETTINGS: resetButtons(settingsButtons); break;
+        for (std::size_t i = 0; i < shopItems.size(); ++i) {
+            if (shopItemButtonRect(i).contains(press->point)) {
+                UiCommand purchase(UiCommand::PURCHASE_ITEM, static_cast<int>(i));
+                purchase.stamp = press->stamp;
+                uiCommands.push(purchase);
+                break;
             }
         }
+    }
 
-        if (achievementDisplayClock.getElapsedTime().asSeconds() > 3.0f) {
-            for (auto& a : achievements) {
-                a.justUnlocked = false;
-            }
+    // Drops the oldest row of guesses once the history would run off the screen
+    void trimGuessHistory() {
+        while (!guessHistory.empty()) {
+            int lastRow = static_cast<int>(guessHistory.size() - 1) / historyColumns;
+            if (lastRow < historyRows) break;
+            std::size_t dropped = std::min(guessHistory.size(), static_cast<std::size_t>(historyColumns));
+            guessHistory.erase(guessHistory.begin(), guessHistory.begin() + dropped);
+        }
+    }
+
+    void updateStaticLayer() {
+        float scale = QualityGovernor::backgroundScale(governor.level());
+        if (staticLayerRendered == frame->staticLayerVersion && staticLayerState == frame->state && staticLayerScale == scale) return;
+
+        // At reduced quality the layer is painted at a fraction of the window
+        // resolution and stretched, which cuts the fill cost of the per-frame blit
+        sf::Vector2u size = window->getSize();
+        sf::Vector2u layerSize(std::max(1u, static_cast<unsigned>(size.x * scale)), std::max(1u, static_cast<unsigned>(size.y * scale)));
+        if (staticLayer.getSize() != layerSize && !staticLayer.create(layerSize.x, layerSize.y)) {
+            std::cerr << "Error: Failed to create static layer, drawing it every frame" << std::endl;
+            staticLayerAvailable = false;
+            return;
         }
+
+        // Painting always happens in window coordinates, whatever the layer size
+        staticLayer.setView(sf::View(sf::FloatRect(0.f, 0.f, static_cast<float>(size.x), static_cast<float>(size.y))));
+        staticLayer.setSmooth(scale < 1.f);
+        paintStaticLayer(staticLayer);
+        staticLayer.display();
+        staticLayerSprite.setTexture(staticLayer.getTexture(), true);
+        staticLayerSprite.setScale(static_cast<float>(size.x) / layerSize.x, static_cast<float>(size.y) / layerSize.y);
+        staticLayerRendered = frame->staticLayerVersion;
+        staticLayerState = frame->state;
+        staticLayerScale = scale;
     }
 
-    void render() {
-        window->clear();
-        window->draw(background);
+    void paintStaticLayer(sf::RenderTarget& target) {
+        target.clear();
+        target.draw(background);
 
-        sf::RectangleShape overlay(sf::Vector2f(static_cast<float>(window->getSize().x), static_cast<float>(window->getSize().y)));
+        sf::RectangleShape overlay(sf::Vector2f(static_cast<float>(target.getView().getSize().x), static_cast<float>(target.getView().getSize().y)));
         overlay.setFillColor(sf::Color(0, 0, 0, 150));
-        window->draw(overlay);
+        target.draw(overlay);
+
+        switch (frame->state) {
+        case MENU: break;
+        case PLAYING: paintGameStatic(target); break;
+        case ACHIEVEMENTS: paintAchievementsStatic(target); break;
+        case DIFFICULTY: paintDifficultyStatic(target); break;
+        case GAME_OVER: paintGameOverStatic(target); break;
+        case SHOP: paintShopStatic(target); break;
+        case SETTINGS: paintSettingsStatic(target); break;
+        case ANALYSIS: paintAnalysisStatic(target); break;
+        }
+    }
 
-        switch (state) {
+    void render(const RenderSnapshot& snap) {
+        TraceZone zone("render");
+        // The lowest quality level also caps the frame rate
+        unsigned frameRateCap = QualityGovernor::frameRateCap(governor.level());
+        if (frameRateCap > 0) {
+            sf::Int64 wait = lastRenderStart + 1000000 / frameRateCap - nowMicros();
+            if (wait > 0) sf::sleep(sf::microseconds(wait));
+        }
+        lastRenderStart = nowMicros();
+
+        frame = &snap;
+        screen = options.offscreen ? static_cast<sf::RenderTarget*>(&offscreenTarget) : window.get();
+        AllocationTracker::Counters& allocations = AllocationTracker::local();
+        std::uint64_t allocationsBefore = allocations.allocations;
+        AllocationTracker::resetSites();
+
+        bool layerChanged = staticLayerRendered != frame->staticLayerVersion || staticLayerState != frame->state
+            || staticLayerScale != QualityGovernor::backgroundScale(governor.level());
+        steadyFrames = layerChanged ? 0 : steadyFrames + 1;
+
+        consumeEffects();
+        particles.update(std::min(presentClock.getElapsedTime().asSeconds(), 0.1f));
+
+        if (staticLayerAvailable) {
+            updateStaticLayer();
+        }
+        if (staticLayerAvailable) {
+            // The layer is opaque, so it replaces clear() and needs no blending
+            screen->draw(staticLayerSprite, sf::RenderStates(sf::BlendNone));
+        }
+        else {
+            paintStaticLayer(*screen);
+        }
+
+        switch (frame->state) {
         case MENU: renderMenu(); break;
         case PLAYING: renderGame(); break;
         case ACHIEVEMENTS: renderAchievements(); break;
@@ -1209,248 +6301,294 @@ private:
         case GAME_OVER: renderGameOver(); break;
         case SHOP: renderShop(); break;
         case SETTINGS: renderSettings(); break;
+        case ANALYSIS: renderAnalysis(); break;
         }
 
-        for (const auto& a : achievements) {
-            if (a.justUnlocked) {
-                renderAchievementUnlocked(a.title);
-                break;
-            }
+        if (frame->toastAchievement >= 0) {
+            renderAchievementUnlocked(achievements[frame->toastAchievement].title);
         }
 
-        window->display();
-    }
-
-    void renderAchievementUnlocked(const std::string& achievementName) {
-        float elapsed = achievementDisplayClock.getElapsedTime().asSeconds();
-        if (elapsed > 3.0f) return;
+        particles.draw(*screen);
 
-        float alpha = 255;
-        if (elapsed > 2.5f) {
-            alpha = 255 * (3.0f - elapsed) / 0.5f;
+        if (options.offscreen) {
+            offscreenTarget.display();
+            if (recorder) recorder->capture(offscreenTarget.getTexture(), nowMicros());
         }
-
-        sf::RectangleShape bg(sf::Vector2f(500.f * getScaleFactor(), 80.f * getScaleFactor()));
-        bg.setPosition(window->getSize().x / 2 - 250.f * getScaleFactor(), 50.f * getScaleFactor());
-        bg.setFillColor(sf::Color(0, 100, 0, static_cast<sf::Uint8>(alpha * 0.8f)));
-        bg.setOutlineThickness(2.f * getScaleFactor());
-        bg.setOutlineColor(sf::Color(255, 215, 0, static_cast<sf::Uint8>(alpha)));
-
-        sf::Text text("Achievement Unlocked: " + achievementName, ResourceManager::getFont(), static_cast<unsigned int>(24 * getScaleFactor()));
-        text.setPosition(window->getSize().x / 2 - text.getLocalBounds().width / 2, 70.f * getScaleFactor());
-        text.setFillColor(sf::Color(255, 255, 255, static_cast<sf::Uint8>(alpha)));
-
-        window->draw(bg);
-        window->draw(text);
+        else {
+            if (recorder) recorder->capture(*window, nowMicros());
+            window->display();
+        }
+        recordPresent();
+        renderedSnapshot.store(frame->sequence, std::memory_order_release);
+        checkFrameAllocations(allocations.allocations - allocationsBefore);
     }
 
-    void renderMenu() {
-        title.setScale(titleScale, titleScale);
-        title.setRotation(titleRotation);
-        title.setFillColor(titleColor);
-        title.setOutlineThickness(outlineThickness);
-        window->draw(title);
+    // Once a screen has settled its frames should not touch the heap; any that
+    // do are reported once per screen with the call sites responsible
+    void checkFrameAllocations(std::uint64_t count) {
+        if (!options.allocationCheck || !staticLayerAvailable || steadyFrames < STEADY_AFTER_FRAMES) return;
+
+        ++steadyFrameCount;
+        if (count == 0) return;
+        ++allocatingFrameCount;
+
+        unsigned screenBit = 1u << frame->state;
+        if (reportedAllocationScreens & screenBit) return;
+        reportedAllocationScreens |= screenBit;
+        std::cerr << "Warning: steady-state frame on screen " << frame->state << " made "
+            << count << " heap allocations" << std::endl;
+        AllocationTracker::reportSites(std::cerr);
+    }
 
-        sf::Text pointsText("Points: " + std::to_string(totalPoints), ResourceManager::getFont(), static_cast<unsigned int>(24 * getScaleFactor()));
-        pointsText.setPosition(window->getSize().x - pointsText.getLocalBounds().width - 30.f * getScaleFactor(), 30.f * getScaleFactor());
-        pointsText.setFillColor(sf::Color::Yellow);
-        window->draw(pointsText);
+    void consumeEffects() {
+        AllocationScope scope("consumeEffects");
+        // Requests older than the ring were overwritten before this frame saw them
+        if (frame->effectSequence - consumedEffects > EFFECT_RING_SIZE) {
+            consumedEffects = frame->effectSequence - EFFECT_RING_SIZE;
+        }
+        const float fraction = QualityGovernor::particleFraction(governor.level());
+        for (; consumedEffects != frame->effectSequence; ++consumedEffects) {
+            const EffectRequest& request = frame->effects[consumedEffects % EFFECT_RING_SIZE];
+            std::size_t count = std::max<std::size_t>(1, static_cast<std::size_t>(request.count * fraction));
+            switch (request.kind) {
+            case EffectRequest::CONFETTI:
+                particles.emitConfetti(sf::Vector2u(static_cast<unsigned>(request.area.width),
+                    static_cast<unsigned>(request.area.height)), count);
+                break;
+            case EffectRequest::EMBERS:
+                particles.emitEmbers(request.area, count);
+                break;
+            case EffectRequest::SPARKS:
+                particles.emitSparks(sf::Vector2f(request.area.left, request.area.top), count);
+                break;
+            }
+        }
+    }
 
-        std::vector<Button*> sortedButtons;
-        for (const auto& btn : buttons) {
-            sortedButtons.push_back(btn.get());
+    void recordPresent() {
+        sf::Int64 frameMicros = presentClock.restart().asMicroseconds();
+        frameTimes.record(frameMicros);
+        telemetry.frameTime->observe(frameMicros);
+        telemetry.qualityFrames[governor.level()]->add();
+
+        // One FRAME event per window keeps frames from flooding the ring:
+        // a is the frames presented in it, b the slowest of them
+        ++flightFrames;
+        flightWorstFrame = std::max(flightWorstFrame, frameMicros);
+        if (nowMicros() - flightWindowStart >= FLIGHT_FRAME_WINDOW) {
+            FlightRecorder::get().record(FlightRecorder::FRAME, QualityGovernor::levelName(governor.level()),
+                flightFrames, flightWorstFrame);
+            flightWindowStart = nowMicros();
+            flightFrames = 0;
+            flightWorstFrame = 0;
         }
-        std::sort(sortedButtons.begin(), sortedButtons.end(), [](Button* a, Button* b) {
-            return a->getZIndex() < b->getZIndex();
-            });
 
-        for (auto btn : sortedButtons) {
-            btn->draw(*window);
+        // The governor judges the cost of drawing the frame, not the time
+        // between frames, which includes idle sleeps and the frame-rate cap
+        QualityGovernor::Level before = governor.level();
+        if (soakMonitor) soakMonitor->recordFrame(nowMicros() - lastRenderStart);
+        if (governor.recordFrame(nowMicros() - lastRenderStart)) {
+            std::cout << "Quality " << (governor.level() > before ? "lowered" : "raised") << " to "
+                << QualityGovernor::levelName(governor.level()) << " (mean render " << std::fixed << std::setprecision(2)
+                << governor.getLastWindowMean() / 1000.0 << " ms, budget " << governor.getBudget() / 1000.0 << " ms)" << std::endl;
+            qualityLevel.store(governor.level(), std::memory_order_relaxed);
+        }
+        if (frame->inputStamp > lastPresentedInput) {
+            inputLatency.record(nowMicros() - frame->inputStamp);
+            lastPresentedInput = frame->inputStamp;
+        }
+        if (frame->commandStamp > lastPresentedCommand) {
+            telemetry.inputToPresent->observe(nowMicros() - frame->commandStamp);
+            lastPresentedCommand = frame->commandStamp;
         }
     }
 
-    void renderGame() {
-        sf::Text gameTitle("Guess the Number", ResourceManager::getFont(), static_cast<unsigned int>(40 * getScaleFactor()));
-        gameTitle.setPosition(static_cast<float>(window->getSize().x) / 2 - gameTitle.getLocalBounds().width / 2, 20.f * getScaleFactor());
-        gameTitle.setFillColor(sf::Color::White);
-        window->draw(gameTitle);
+    // Draws the buttons of the snapshot's screen
+    void drawButtons() {
+        AllocationScope scope("drawButtons");
+        if (!frame->screen) return;
+        const ButtonSet& set = frame->screen->buttons;
+        buttonOrder.clear();
+        for (std::size_t i = 0; i < set.size() && i < frame->buttonVisuals.size(); ++i) {
+            buttonOrder.push_back(i);
+        }
+        std::sort(buttonOrder.begin(), buttonOrder.end(), [&](std::size_t a, std::size_t b) {
+            return frame->buttonVisuals[a].zIndex < frame->buttonVisuals[b].zIndex;
+            });
 
-        std::string difficultyText;
-        switch (difficulty) {
-        case EASY: difficultyText = "Easy (1-50)"; break;
-        case MEDIUM: difficultyText = "Medium (1-100)"; break;
-        case HARD: difficultyText = "Hard (1-200)"; break;
-        case EXPERT: difficultyText = "Expert (1-500)"; break;
-        case MASTER: difficultyText = "Master (1-1000)"; break;
+        for (auto i : buttonOrder) {
+            widgets.draw(*screen, set[i], frame->buttonVisuals[i]);
         }
+    }
 
-        sf::Text difficultyDisplay(difficultyText, ResourceManager::getFont(), static_cast<unsigned int>(20 * getScaleFactor()));
-        difficultyDisplay.setPosition(30.f * getScaleFactor(), 70.f * getScaleFactor());
-        difficultyDisplay.setFillColor(sf::Color::Yellow);
-        window->draw(difficultyDisplay);
+    void renderAchievementUnlocked(const std::string& achievementName) {
+        float alpha = frame->toastAlpha;
+        if (alpha <= 0.f) return;
 
-        std::string attemptsText = maxAttempts > 0 ?
-            "Attempts: " + std::to_string(attempts) + "/" + std::to_string(maxAttempts) :
-            "Attempts: " + std::to_string(attempts);
+        TraceZone zone("renderAchievementUnlocked");
+        AllocationScope scope("renderAchievementUnlocked");
+        toastBg.setFillColor(sf::Color(0, 100, 0, static_cast<sf::Uint8>(alpha * 0.8f)));
+        toastBg.setOutlineColor(sf::Color(255, 215, 0, static_cast<sf::Uint8>(alpha)));
 
-        sf::Text attemptsDisplay(attemptsText, ResourceManager::getFont(), static_cast<unsigned int>(20 * getScaleFactor()));
-        attemptsDisplay.setPosition(window->getSize().x - attemptsDisplay.getLocalBounds().width - 30.f * getScaleFactor(), 70.f * getScaleFactor());
-        attemptsDisplay.setFillColor(sf::Color::Yellow);
-        window->draw(attemptsDisplay);
+        toastLabel.setStyle(static_cast<unsigned int>(24 * getScaleFactor()), sf::Color(255, 255, 255, static_cast<sf::Uint8>(alpha)));
+        toastLabel.format("Achievement Unlocked: %s", achievementName.c_str());
 
-        if (timerActive) {
-            int seconds = static_cast<int>(timeRemaining.asSeconds());
-            int minutes = seconds / 60;
-            seconds %= 60;
+        screen->draw(toastBg);
+        screen->draw(toastLabel.get());
+    }
 
-            std::ostringstream timeStream;
-            timeStream << "Time: " << std::setw(2) << std::setfill('0') << minutes << ":"
-                << std::setw(2) << std::setfill('0') << seconds;
+    void renderMenu() {
+        TraceZone zone("renderMenu");
+        AllocationScope scope("renderMenu");
+        title.setScale(frame->titleScale, frame->titleScale);
+        title.setRotation(frame->titleRotation);
+        title.setFillColor(frame->titleColor);
+        title.setOutlineThickness(frame->titleOutline);
+        screen->draw(title);
+
+        pointsLabel.setStyle(static_cast<unsigned int>(24 * getScaleFactor()), sf::Color::Yellow);
+        pointsLabel.format("Points: %d", frame->totalPoints);
+        screen->draw(pointsLabel.get());
+
+        drawButtons();
+    }
 
-            sf::Text timerDisplay(timeStream.str(), ResourceManager::getFont(), static_cast<unsigned int>(24 * getScaleFactor()));
-            timerDisplay.setPosition(window->getSize().x / 2 - timerDisplay.getLocalBounds().width / 2, 70.f * getScaleFactor());
+    void paintGameStatic(sf::RenderTarget& target) {
+        sf::Text gameTitle("Guess the Number", ResourceManager::getFont(), static_cast<unsigned int>(40 * getScaleFactor()));
+        gameTitle.setPosition(static_cast<float>(target.getView().getSize().x) / 2 - gameTitle.getLocalBounds().width / 2, 20.f * getScaleFactor());
+        gameTitle.setFillColor(sf::Color::White);
+        target.draw(gameTitle);
 
-            if (timeRemaining < sf::seconds(10)) {
-                float blink = std::sin(gameClock.getElapsedTime().asSeconds() * 10.f) * 0.5f + 0.5f;
-                timerDisplay.setFillColor(sf::Color(255, static_cast<sf::Uint8>(blink * 255), 0));
-            }
-            else if (timeRemaining < sf::seconds(30)) {
-                timerDisplay.setFillColor(sf::Color::Red);
-            }
-            else {
-                timerDisplay.setFillColor(sf::Color::Green);
-            }
+        const DifficultyRules& rules = DIFFICULTY_RULES[frame->difficulty];
+        std::string difficultyText = std::string(rules.name) + " (1-" + std::to_string(rules.range) + ")";
 
-            window->draw(timerDisplay);
-        }
+        sf::Text difficultyDisplay(difficultyText, ResourceManager::getFont(), static_cast<unsigned int>(20 * getScaleFactor()));
+        difficultyDisplay.setPosition(30.f * getScaleFactor(), 70.f * getScaleFactor());
+        difficultyDisplay.setFillColor(sf::Color::Yellow);
+        target.draw(difficultyDisplay);
 
-        sf::RectangleShape inputBg(sf::Vector2f(400.f * getScaleFactor(), 80.f * getScaleFactor()));
-        inputBg.setPosition(50.f * getScaleFactor(), 120.f * getScaleFactor());
+        const sf::FloatRect& inputBox = layout.rect(ui.inputBox);
+        sf::RectangleShape inputBg(sf::Vector2f(inputBox.width, inputBox.height));
+        inputBg.setPosition(inputBox.left, inputBox.top);
         inputBg.setFillColor(sf::Color(0, 0, 0, 100));
         inputBg.setOutlineThickness(2.f * getScaleFactor());
         inputBg.setOutlineColor(sf::Color::White);
-        window->draw(inputBg);
+        target.draw(inputBg);
 
-        sf::Text prompt("Enter number (1-" + std::to_string(range) + "):", ResourceManager::getFont(), static_cast<unsigned int>(24 * getScaleFactor()));
+        sf::Text prompt("Enter number (1-" + std::to_string(frame->range) + "):", ResourceManager::getFont(), static_cast<unsigned int>(24 * getScaleFactor()));
         prompt.setPosition(60.f * getScaleFactor(), 130.f * getScaleFactor());
-        window->draw(prompt);
-
-        sf::Text input(inputStr, ResourceManager::getFont(), static_cast<unsigned int>(36 * getScaleFactor()));
-        input.setPosition(60.f * getScaleFactor(), 160.f * getScaleFactor());
-        input.setFillColor(inputColor);
-        window->draw(input);
-
-        sf::Text hint(currentHint, ResourceManager::getFont(), static_cast<unsigned int>(30 * getScaleFactor()));
-        hint.setPosition(470.f * getScaleFactor(), 140.f * getScaleFactor());
-        hint.setFillColor(sf::Color::Yellow);
-        window->draw(hint);
+        target.draw(prompt);
 
         sf::Text historyTitle("Your guesses:", ResourceManager::getFont(), static_cast<unsigned int>(30 * getScaleFactor()));
         historyTitle.setPosition(50.f * getScaleFactor(), 220.f * getScaleFactor());
-        window->draw(historyTitle);
+        target.draw(historyTitle);
+    }
 
-        const int maxPerRow = (window->getSize().x - 100 * getScaleFactor()) / static_cast<int>(300 * getScaleFactor());
-        const int rowHeight = static_cast<int>(40 * getScaleFactor());
+    void renderGame() {
+        TraceZone zone("renderGame");
+        AllocationScope scope("renderGame");
 
-        for (size_t i = 0; i < guessHistory.size(); ++i) {
-            int row = static_cast<int>(i) / maxPerRow;
-            int col = static_cast<int>(i) % maxPerRow;
+        attemptsLabel.setStyle(static_cast<unsigned int>(20 * getScaleFactor()), sf::Color::Yellow);
+        if (frame->maxAttempts > 0) {
+            attemptsLabel.format("Attempts: %d/%d", frame->attempts, frame->maxAttempts);
+        }
+        else {
+            attemptsLabel.format("Attempts: %d", frame->attempts);
+        }
+        screen->draw(attemptsLabel.get());
 
-            float xPos = 50.f * getScaleFactor() + col * 300.f * getScaleFactor();
-            float yPos = 260.f * getScaleFactor() + row * rowHeight;
+        if (frame->timerActive) {
+            int seconds = static_cast<int>(frame->timeRemaining.asSeconds());
+            int minutes = seconds / 60;
+            seconds %= 60;
 
-            if (yPos > window->getSize().y - 100 * getScaleFactor()) {
-                guessHistory.erase(guessHistory.begin(), guessHistory.begin() + maxPerRow);
-                i -= maxPerRow;
-                continue;
+            sf::Color timerColor = sf::Color::Green;
+            if (frame->timerWarning >= 2) {
+                timerColor = frame->timerBlinkOn ? sf::Color::Yellow : sf::Color::Red;
+            }
+            else if (frame->timerWarning == 1) {
+                timerColor = sf::Color::Red;
             }
 
-            sf::Text guessText(
-                std::to_string(guessHistory[i].value) + " (" + guessHistory[i].hint + ")",
-                ResourceManager::getFont(), static_cast<unsigned int>(24 * getScaleFactor())
-            );
-            guessText.setPosition(xPos, yPos);
-            guessText.setFillColor(guessHistory[i].color);
-            window->draw(guessText);
+            timerLabel.setStyle(static_cast<unsigned int>(24 * getScaleFactor()), timerColor);
+            timerLabel.format("Time: %02d:%02d", minutes, seconds);
+            screen->draw(timerLabel.get());
         }
 
-        if (gameWon) {
-            sf::Text win("YOU WIN! Attempts: " + std::to_string(attempts),
-                ResourceManager::getFont(), static_cast<unsigned int>(50 * getScaleFactor()));
-            win.setPosition(static_cast<float>(window->getSize().x) / 2 - win.getLocalBounds().width / 2, 400.f * getScaleFactor());
-            win.setFillColor(sf::Color::Green);
-            window->draw(win);
-
-            if (timerActive) {
-                int seconds = static_cast<int>(timeRemaining.asSeconds());
-                int minutes = seconds / 60;
-                seconds %= 60;
+        inputLabel.setStyle(static_cast<unsigned int>(36 * getScaleFactor()), frame->inputColor);
+        inputLabel.format("%s", frame->inputStr.c_str());
+        screen->draw(inputLabel.get());
 
-                std::ostringstream timeStream;
-                timeStream << "Time left: " << std::setw(2) << std::setfill('0') << minutes << ":"
-                    << std::setw(2) << std::setfill('0') << seconds;
+        hintLabel.setStyle(static_cast<unsigned int>(30 * getScaleFactor()), sf::Color::Yellow);
+        hintLabel.format("%s", frame->currentHint.c_str());
+        screen->draw(hintLabel.get());
 
-                sf::Text timeLeft(timeStream.str(), ResourceManager::getFont(), static_cast<unsigned int>(30 * getScaleFactor()));
-                timeLeft.setPosition(window->getSize().x / 2 - timeLeft.getLocalBounds().width / 2, 460.f * getScaleFactor());
-                timeLeft.setFillColor(sf::Color::Cyan);
-                window->draw(timeLeft);
-            }
+        // A label keeps its slot of the history grid until the layout changes
+        for (std::size_t i = historyLabels.size(); i < frame->guessHistory.size(); ++i) {
+            historyLabels.emplace_back();
+            historyLabels.back().setAnchor(historyPosition(i), 0.f);
         }
-
-        std::vector<Button*> sortedButtons;
-        for (const auto& btn : gameButtons) {
-            sortedButtons.push_back(btn.get());
+        for (size_t i = 0; i < frame->guessHistory.size(); ++i) {
+            CachedText& label = historyLabels[i];
+            label.setStyle(static_cast<unsigned int>(24 * getScaleFactor()), frame->guessHistory[i].color);
+            label.format("%d (%s)", frame->guessHistory[i].value, frame->guessHistory[i].hint.c_str());
+            screen->draw(label.get());
         }
-        std::sort(sortedButtons.begin(), sortedButtons.end(), [](Button* a, Button* b) {
-            return a->getZIndex() < b->getZIndex();
-            });
 
-        for (auto btn : sortedButtons) {
-            btn->draw(*window);
+        if (frame->gameWon) {
+            winLabel.setStyle(static_cast<unsigned int>(50 * getScaleFactor()), sf::Color::Green);
+            winLabel.format("YOU WIN! Attempts: %d", frame->attempts);
+            screen->draw(winLabel.get());
+
+            if (frame->timerActive) {
+                int seconds = static_cast<int>(frame->timeRemaining.asSeconds());
+                int minutes = seconds / 60;
+                seconds %= 60;
+
+                timeLeftLabel.setStyle(static_cast<unsigned int>(30 * getScaleFactor()), sf::Color::Cyan);
+                timeLeftLabel.format("Time left: %02d:%02d", minutes, seconds);
+                screen->draw(timeLeftLabel.get());
+            }
         }
+
+        drawButtons();
     }
 
-    void renderGameOver() {
+    void paintGameOverStatic(sf::RenderTarget& target) {
         sf::Text gameOverText("GAME OVER", ResourceManager::getFont(), static_cast<unsigned int>(60 * getScaleFactor()));
-        gameOverText.setPosition(static_cast<float>(window->getSize().x) / 2 - gameOverText.getLocalBounds().width / 2, 150.f * getScaleFactor());
+        gameOverText.setPosition(static_cast<float>(target.getView().getSize().x) / 2 - gameOverText.getLocalBounds().width / 2, 150.f * getScaleFactor());
         gameOverText.setFillColor(sf::Color::Red);
-        window->draw(gameOverText);
+        target.draw(gameOverText);
 
-        std::string resultText = timeUp ?
-            "Time's up! The number was: " + std::to_string(secretNumber) :
-            "Out of attempts! The number was: " + std::to_string(secretNumber);
+        std::string resultText = frame->timeUp ?
+            "Time's up! The number was: " + std::to_string(frame->secretNumber) :
+            "Out of attempts! The number was: " + std::to_string(frame->secretNumber);
 
         sf::Text result(resultText, ResourceManager::getFont(), static_cast<unsigned int>(30 * getScaleFactor()));
-        result.setPosition(static_cast<float>(window->getSize().x) / 2 - result.getLocalBounds().width / 2, 250.f * getScaleFactor());
+        result.setPosition(static_cast<float>(target.getView().getSize().x) / 2 - result.getLocalBounds().width / 2, 250.f * getScaleFactor());
         result.setFillColor(sf::Color::White);
-        window->draw(result);
+        target.draw(result);
 
-        sf::Text attemptsText("Your attempts: " + std::to_string(attempts), ResourceManager::getFont(), static_cast<unsigned int>(30 * getScaleFactor()));
-        attemptsText.setPosition(static_cast<float>(window->getSize().x) / 2 - attemptsText.getLocalBounds().width / 2, 300.f * getScaleFactor());
+        sf::Text attemptsText("Your attempts: " + std::to_string(frame->attempts), ResourceManager::getFont(), static_cast<unsigned int>(30 * getScaleFactor()));
+        attemptsText.setPosition(static_cast<float>(target.getView().getSize().x) / 2 - attemptsText.getLocalBounds().width / 2, 300.f * getScaleFactor());
         attemptsText.setFillColor(sf::Color::Yellow);
-        window->draw(attemptsText);
-
-        std::vector<Button*> sortedButtons;
-        for (const auto& btn : gameButtons) {
-            sortedButtons.push_back(btn.get());
-        }
-        std::sort(sortedButtons.begin(), sortedButtons.end(), [](Button* a, Button* b) {
-            return a->getZIndex() < b->getZIndex();
-            });
+        target.draw(attemptsText);
+    }
 
-        for (auto btn : sortedButtons) {
-            btn->draw(*window);
-        }
+    void renderGameOver() {
+        TraceZone zone("renderGameOver");
+        AllocationScope scope("renderGameOver");
+        drawButtons();
     }
 
-    void renderAchievements() {
+    void paintAchievementsStatic(sf::RenderTarget& target) {
         sf::Text title("Achievements", ResourceManager::getFont(), static_cast<unsigned int>(50 * getScaleFactor()));
-        title.setPosition(static_cast<float>(window->getSize().x) / 2 - title.getLocalBounds().width / 2, 50.f * getScaleFactor());
+        title.setPosition(static_cast<float>(target.getView().getSize().x) / 2 - title.getLocalBounds().width / 2, 50.f * getScaleFactor());
         title.setFillColor(sf::Color::White);
-        window->draw(title);
+        target.draw(title);
 
-        const float areaWidth = window->getSize().x - 100.f * getScaleFactor();
-        const float areaHeight = window->getSize().y - 200.f * getScaleFactor();
+        const float areaWidth = target.getView().getSize().x - 100.f * getScaleFactor();
+        const float areaHeight = target.getView().getSize().y - 200.f * getScaleFactor();
         const float areaX = 50.f * getScaleFactor();
         const float areaY = 120.f * getScaleFactor();
 
@@ -1459,7 +6597,7 @@ private:
         achievementsBg.setFillColor(sf::Color(0, 0, 0, 150));
         achievementsBg.setOutlineThickness(2.f * getScaleFactor());
         achievementsBg.setOutlineColor(sf::Color::White);
-        window->draw(achievementsBg);
+        target.draw(achievementsBg);
 
         const float entryHeight = 60.f * getScaleFactor();
         const float entryWidth = areaWidth - 20.f * getScaleFactor();
@@ -1476,175 +6614,129 @@ private:
             entryBg.setPosition(startX, yPos);
             entryBg.setFillColor(sf::Color(0, 0, 0, 100));
             entryBg.setOutlineThickness(1.f * getScaleFactor());
-            entryBg.setOutlineColor(achievements[i].unlocked ? sf::Color::Green : sf::Color::Red);
-            window->draw(entryBg);
+            entryBg.setOutlineColor(frame->achievementUnlocked[i] ? sf::Color::Green : sf::Color::Red);
+            target.draw(entryBg);
 
             sf::Text titleText(achievements[i].title, ResourceManager::getFont(), static_cast<unsigned int>(20 * getScaleFactor()));
             titleText.setPosition(startX + 10.f * getScaleFactor(), yPos + 5.f * getScaleFactor());
-            titleText.setFillColor(achievements[i].unlocked ? sf::Color::Green : sf::Color(150, 150, 150));
-            window->draw(titleText);
+            titleText.setFillColor(frame->achievementUnlocked[i] ? sf::Color::Green : sf::Color(150, 150, 150));
+            target.draw(titleText);
 
             sf::Text descText(achievements[i].desc, ResourceManager::getFont(), static_cast<unsigned int>(16 * getScaleFactor()));
             descText.setPosition(startX + 10.f * getScaleFactor(), yPos + 30.f * getScaleFactor());
             descText.setFillColor(sf::Color::White);
-            window->draw(descText);
+            target.draw(descText);
 
-            sf::Text statusText(achievements[i].unlocked ? "[X]" : "[ ]", ResourceManager::getFont(), static_cast<unsigned int>(20 * getScaleFactor()));
+            sf::Text statusText(frame->achievementUnlocked[i] ? "[X]" : "[ ]", ResourceManager::getFont(), static_cast<unsigned int>(20 * getScaleFactor()));
             statusText.setPosition(startX + entryWidth - 40.f * getScaleFactor(), yPos + 20.f * getScaleFactor());
-            statusText.setFillColor(achievements[i].unlocked ? sf::Color::Green : sf::Color::Red);
-            window->draw(statusText);
+            statusText.setFillColor(frame->achievementUnlocked[i] ? sf::Color::Green : sf::Color::Red);
+            target.draw(statusText);
         }
+    }
 
-        std::vector<Button*> sortedButtons;
-        for (const auto& btn : achievementButtons) {
-            sortedButtons.push_back(btn.get());
-        }
-        std::sort(sortedButtons.begin(), sortedButtons.end(), [](Button* a, Button* b) {
-            return a->getZIndex() < b->getZIndex();
-            });
+    void renderAchievements() {
+        TraceZone zone("renderAchievements");
+        AllocationScope scope("renderAchievements");
+        drawButtons();
+    }
 
-        for (auto btn : sortedButtons) {
-            btn->draw(*window);
+    static std::vector<std::string> difficultyDescription(const DifficultyRules& rules) {
+        std::string timer = "No";
+        if (rules.timeLimitSeconds % 60 == 0 && rules.timeLimitSeconds > 0) {
+            int minutes = rules.timeLimitSeconds / 60;
+            timer = std::to_string(minutes) + (minutes == 1 ? " minute" : " minutes");
+        }
+        else if (rules.timeLimitSeconds > 0) {
+            timer = std::to_string(rules.timeLimitSeconds) + " seconds";
         }
+        return {
+            "Range: 1-" + std::to_string(rules.range),
+            "Attempts: " + (rules.maxAttempts > 0 ? std::to_string(rules.maxAttempts) : std::string("Unlimited")),
+            "Timer: " + timer
+        };
     }
 
-    void renderDifficulty() {
+    void paintDifficultyStatic(sf::RenderTarget& target) {
         sf::Text title("Select Difficulty", ResourceManager::getFont(), static_cast<unsigned int>(50 * getScaleFactor()));
-        title.setPosition(static_cast<float>(window->getSize().x) / 2 - title.getLocalBounds().width / 2, 50.f * getScaleFactor());
+        title.setPosition(static_cast<float>(target.getView().getSize().x) / 2 - title.getLocalBounds().width / 2, 50.f * getScaleFactor());
         title.setFillColor(sf::Color::White);
-        window->draw(title);
-
-        const float buttonWidth = 200.f * getScaleFactor();
-        const float buttonHeight = 45.f * getScaleFactor();
-        const float spacingX = 30.f * getScaleFactor();
-        const float spacingY = 40.f * getScaleFactor();
-        const float descOffset = 60.f * getScaleFactor();
-        const float totalWidth = (buttonWidth * 3) + (spacingX * 2);
-        const float startX = (window->getSize().x - totalWidth) / 2;
-        const float startY = window->getSize().y * 0.3f;
-
-        // First row - Easy, Medium, Hard
-        std::vector<std::pair<std::string, std::vector<std::string>>> firstRowDifficulties = {
-            {"Easy", {"Range: 1-50", "Attempts: Unlimited", "Timer: No"}},
-            {"Medium", {"Range: 1-100", "Attempts: 15", "Timer: No"}},
-            {"Hard", {"Range: 1-200", "Attempts: 10", "Timer: No"}}
-        };
-
-        for (size_t i = 0; i < firstRowDifficulties.size(); ++i) {
-            float xPos = startX + i * (buttonWidth + spacingX);
-            float yPos = startY;
-
-            // Draw button
-            difficultyButtons[i]->draw(*window);
-
-            // Draw description box
-            sf::RectangleShape descBox(sf::Vector2f(buttonWidth, 100.f * getScaleFactor()));
-            descBox.setPosition(xPos, yPos + buttonHeight + 10.f * getScaleFactor());
-            descBox.setFillColor(sf::Color(0, 0, 0, 150));
-            descBox.setOutlineThickness(2.f * getScaleFactor());
-            descBox.setOutlineColor(sf::Color::White);
-            window->draw(descBox);
-
-            // Draw description text
-            for (size_t j = 0; j < firstRowDifficulties[i].second.size(); ++j) {
-                sf::Text descText(firstRowDifficulties[i].second[j], ResourceManager::getFont(), static_cast<unsigned int>(14 * getScaleFactor()));
-                descText.setPosition(xPos + 10.f * getScaleFactor(), yPos + buttonHeight + 20.f * getScaleFactor() + j * 20.f * getScaleFactor());
-                descText.setFillColor(sf::Color::White);
-                window->draw(descText);
-            }
-        }
-
-        // Second row - Expert, Master
-        std::vector<std::pair<std::string, std::vector<std::string>>> secondRowDifficulties = {
-            {"Expert", {"Range: 1-500", "Attempts: 7", "Timer: 2 minutes"}},
-            {"Master", {"Range: 1-1000", "Attempts: 5", "Timer: 1 minute"}}
-        };
-
-        float secondRowY = startY + buttonHeight + descOffset + spacingY;
-        for (size_t i = 0; i < secondRowDifficulties.size(); ++i) {
-            float xPos = startX + (buttonWidth + spacingX) * i + buttonWidth / 2;
-            float yPos = secondRowY;
-
-            // Draw button
-            difficultyButtons[3 + i]->draw(*window);
-
-            // Draw description box
-            sf::RectangleShape descBox(sf::Vector2f(buttonWidth, 100.f * getScaleFactor()));
-            descBox.setPosition(xPos, yPos + buttonHeight + 10.f * getScaleFactor());
+        target.draw(title);
+
+        // The boxes under the difficulty buttons, laid out with them in describeLayout
+        const float scale = getScaleFactor();
+        for (int d = 0; d < DIFFICULTY_COUNT; ++d) {
+            const sf::FloatRect& box = layout.rect(ui.difficultyInfo[d]);
+            sf::RectangleShape descBox(sf::Vector2f(box.width, box.height));
+            descBox.setPosition(box.left, box.top);
             descBox.setFillColor(sf::Color(0, 0, 0, 150));
-            descBox.setOutlineThickness(2.f * getScaleFactor());
+            descBox.setOutlineThickness(2.f * scale);
             descBox.setOutlineColor(sf::Color::White);
-            window->draw(descBox);
+            target.draw(descBox);
 
-            // Draw description text
-            for (size_t j = 0; j < secondRowDifficulties[i].second.size(); ++j) {
-                sf::Text descText(secondRowDifficulties[i].second[j], ResourceManager::getFont(), static_cast<unsigned int>(14 * getScaleFactor()));
-                descText.setPosition(xPos + 10.f * getScaleFactor(), yPos + buttonHeight + 20.f * getScaleFactor() + j * 20.f * getScaleFactor());
+            std::vector<std::string> lines = difficultyDescription(DIFFICULTY_RULES[d]);
+            for (size_t j = 0; j < lines.size(); ++j) {
+                sf::Text descText(lines[j], ResourceManager::getFont(), static_cast<unsigned int>(14 * scale));
+                descText.setPosition(box.left + 10.f * scale, box.top + 10.f * scale + j * 20.f * scale);
                 descText.setFillColor(sf::Color::White);
-                window->draw(descText);
+                target.draw(descText);
             }
         }
+    }
 
-        // Draw back button
-        difficultyButtons.back()->draw(*window);
+    void renderDifficulty() {
+        TraceZone zone("renderDifficulty");
+        AllocationScope scope("renderDifficulty");
+        drawButtons();
     }
 
-    void renderShop() {
+    void paintShopStatic(sf::RenderTarget& target) {
         sf::Text title("Shop", ResourceManager::getFont(), static_cast<unsigned int>(50 * getScaleFactor()));
-        title.setPosition(static_cast<float>(window->getSize().x) / 2 - title.getLocalBounds().width / 2, 50.f * getScaleFactor());
+        title.setPosition(static_cast<float>(target.getView().getSize().x) / 2 - title.getLocalBounds().width / 2, 50.f * getScaleFactor());
         title.setFillColor(sf::Color::White);
-        window->draw(title);
-
-        sf::Text pointsText("Points: " + std::to_string(totalPoints), ResourceManager::getFont(), static_cast<unsigned int>(30 * getScaleFactor()));
-        pointsText.setPosition(window->getSize().x / 2 - pointsText.getLocalBounds().width / 2, 100.f * getScaleFactor());
-        pointsText.setFillColor(sf::Color::Yellow);
-        window->draw(pointsText);
+        target.draw(title);
 
-        const float areaWidth = window->getSize().x - 100.f * getScaleFactor();
-        const float areaHeight = window->getSize().y - 250.f * getScaleFactor();
-        const float areaX = 50.f * getScaleFactor();
-        const float areaY = 150.f * getScaleFactor();
-
-        sf::RectangleShape shopBg(sf::Vector2f(areaWidth, areaHeight));
-        shopBg.setPosition(areaX, areaY);
+        const sf::FloatRect& area = layout.rect(ui.shopArea);
+        sf::RectangleShape shopBg(sf::Vector2f(area.width, area.height));
+        shopBg.setPosition(area.left, area.top);
         shopBg.setFillColor(sf::Color(0, 0, 0, 150));
         shopBg.setOutlineThickness(2.f * getScaleFactor());
         shopBg.setOutlineColor(sf::Color::White);
-        window->draw(shopBg);
+        target.draw(shopBg);
 
-        const float itemWidth = areaWidth - 20.f * getScaleFactor();
-        const float itemHeight = 80.f * getScaleFactor();
-        const float startX = areaX + 10.f * getScaleFactor();
-        const float startY = areaY + 10.f * getScaleFactor();
-        const float padding = 15.f * getScaleFactor();
+        sf::Text pointsText("Points: " + std::to_string(frame->totalPoints), ResourceManager::getFont(), static_cast<unsigned int>(30 * getScaleFactor()));
+        pointsText.setPosition(target.getView().getSize().x / 2 - pointsText.getLocalBounds().width / 2, 100.f * getScaleFactor());
+        pointsText.setFillColor(sf::Color::Yellow);
+        target.draw(pointsText);
 
         for (size_t i = 0; i < shopItems.size(); ++i) {
-            float yPos = startY + i * (itemHeight + padding);
-
-            if (yPos + itemHeight > areaY + areaHeight) break;
+            if (!shopRowShown(i)) break;
+            const sf::FloatRect& row = layout.rect(ui.shopRows[i]);
+            const float startX = row.left;
+            const float yPos = row.top;
+            const float itemWidth = row.width;
 
-            sf::RectangleShape itemBg(sf::Vector2f(itemWidth, itemHeight));
+            sf::RectangleShape itemBg(sf::Vector2f(row.width, row.height));
             itemBg.setPosition(startX, yPos);
             itemBg.setFillColor(sf::Color(0, 0, 0, 100));
             itemBg.setOutlineThickness(1.f * getScaleFactor());
-            itemBg.setOutlineColor(shopItems[i].purchased ?
-                (shopItems[i].active ? sf::Color::Green : sf::Color(100, 255, 100)) :
+            itemBg.setOutlineColor(frame->shopPurchased[i] ?
+                (frame->shopActive[i] ? sf::Color::Green : sf::Color(100, 255, 100)) :
                 sf::Color::Blue);
-            window->draw(itemBg);
+            target.draw(itemBg);
 
             sf::Text nameText(shopItems[i].name, ResourceManager::getFont(), static_cast<unsigned int>(20 * getScaleFactor()));
             nameText.setPosition(startX + 10.f * getScaleFactor(), yPos + 5.f * getScaleFactor());
             nameText.setFillColor(sf::Color::White);
-            window->draw(nameText);
+            target.draw(nameText);
 
             sf::Text descText(shopItems[i].description, ResourceManager::getFont(), static_cast<unsigned int>(16 * getScaleFactor()));
             descText.setPosition(startX + 10.f * getScaleFactor(), yPos + 30.f * getScaleFactor());
             descText.setFillColor(sf::Color(200, 200, 200));
-            window->draw(descText);
+            target.draw(descText);
 
             std::string statusStr;
-            if (shopItems[i].purchased) {
-                statusStr = shopItems[i].active ? "ACTIVE" : "INACTIVE";
+            if (frame->shopPurchased[i]) {
+                statusStr = frame->shopActive[i] ? "ACTIVE" : "INACTIVE";
             }
             else {
                 statusStr = "Cost: " + std::to_string(shopItems[i].cost);
@@ -1652,24 +6744,25 @@ private:
 
             sf::Text statusText(statusStr, ResourceManager::getFont(), static_cast<unsigned int>(20 * getScaleFactor()));
             statusText.setPosition(startX + itemWidth - statusText.getLocalBounds().width - 10.f * getScaleFactor(), yPos + 5.f * getScaleFactor());
-            statusText.setFillColor(shopItems[i].purchased ?
-                (shopItems[i].active ? sf::Color::Green : sf::Color(200, 200, 200)) :
+            statusText.setFillColor(frame->shopPurchased[i] ?
+                (frame->shopActive[i] ? sf::Color::Green : sf::Color(200, 200, 200)) :
                 sf::Color::Yellow);
-            window->draw(statusText);
+            target.draw(statusText);
 
-            sf::RectangleShape button(sf::Vector2f(100.f * getScaleFactor(), 30.f * getScaleFactor()));
-            button.setPosition(startX + itemWidth - 110.f * getScaleFactor(), yPos + 40.f * getScaleFactor());
+            const sf::FloatRect buyRect = shopItemButtonRect(i);
+            sf::RectangleShape button(sf::Vector2f(buyRect.width, buyRect.height));
+            button.setPosition(buyRect.left, buyRect.top);
             button.setFillColor(sf::Color(0, 0, 0, 150));
             button.setOutlineThickness(1.f * getScaleFactor());
             button.setOutlineColor(sf::Color::White);
-            window->draw(button);
+            target.draw(button);
 
             std::string buttonText;
-            if (!shopItems[i].purchased) {
+            if (!frame->shopPurchased[i]) {
                 buttonText = "Buy";
             }
             else {
-                buttonText = shopItems[i].active ? "Deactivate" : "Activate";
+                buttonText = frame->shopActive[i] ? "Deactivate" : "Activate";
             }
 
             sf::Text buttonTextObj(buttonText, ResourceManager::getFont(), static_cast<unsigned int>(16 * getScaleFactor()));
@@ -1678,44 +6771,333 @@ private:
                 button.getPosition().y + 5.f * getScaleFactor()
             );
             buttonTextObj.setFillColor(sf::Color::White);
-            window->draw(buttonTextObj);
-
-            if (shopButtonPressed) {
-                sf::Vector2f mousePos = window->mapPixelToCoords(sf::Mouse::getPosition(*window));
-                if (button.getGlobalBounds().contains(mousePos)) {
-                    purchaseItem(static_cast<int>(i));
-                    shopButtonPressed = false;
-                }
-            }
+            target.draw(buttonTextObj);
         }
+    }
 
-        shopButtons[0]->draw(*window);
+    void renderShop() {
+        TraceZone zone("renderShop");
+        AllocationScope scope("renderShop");
+        drawButtons();
     }
 
-    void renderSettings() {
+    void paintSettingsStatic(sf::RenderTarget& target) {
         sf::Text title("Settings", ResourceManager::getFont(), static_cast<unsigned int>(50 * getScaleFactor()));
-        title.setPosition(static_cast<float>(window->getSize().x) / 2 - title.getLocalBounds().width / 2, 50.f * getScaleFactor());
+        title.setPosition(static_cast<float>(target.getView().getSize().x) / 2 - title.getLocalBounds().width / 2, 50.f * getScaleFactor());
         title.setFillColor(sf::Color::White);
-        window->draw(title);
+        target.draw(title);
 
         sf::Text resolutionTitle("Resolution:", ResourceManager::getFont(), static_cast<unsigned int>(30 * getScaleFactor()));
-        resolutionTitle.setPosition(window->getSize().x * 0.6f - resolutionTitle.getLocalBounds().width / 2, window->getSize().y * 0.2f);
-        window->draw(resolutionTitle);
+        resolutionTitle.setPosition(target.getView().getSize().x * 0.6f - resolutionTitle.getLocalBounds().width / 2, target.getView().getSize().y * 0.2f);
+        target.draw(resolutionTitle);
+
+        sf::Text profileTitle("Profile:", ResourceManager::getFont(), static_cast<unsigned int>(30 * getScaleFactor()));
+        profileTitle.setPosition(layout.rect(ui.profile).left, target.getView().getSize().y * 0.2f);
+        target.draw(profileTitle);
+
+        sf::Text profileName(frame->profileName.empty() ? "(not saved)" : frame->profileName, ResourceManager::getFont(),
+            static_cast<unsigned int>(24 * getScaleFactor()));
+        profileName.setPosition(layout.point(ui.profileName));
+        profileName.setFillColor(sf::Color::Yellow);
+        target.draw(profileName);
+    }
+
+    void renderSettings() {
+        TraceZone zone("renderSettings");
+        AllocationScope scope("renderSettings");
+        drawButtons();
+    }
+
+    void paintAnalysisStatic(sf::RenderTarget& target) {
+        const float scale = getScaleFactor();
+        const unsigned int rowSize = static_cast<unsigned int>(22 * scale);
+
+        sf::Text title("Game Analysis", ResourceManager::getFont(), static_cast<unsigned int>(50 * scale));
+        title.setPosition(static_cast<float>(target.getView().getSize().x) / 2 - title.getLocalBounds().width / 2, 30.f * scale);
+        title.setFillColor(sf::Color::White);
+        target.draw(title);
+
+        float gained = 0.f;
+        float best = 0.f;
+        for (const auto& entry : frame->analysis) {
+            gained += entry.bitsGained;
+            best += entry.bestBits;
+        }
+
+        std::ostringstream summary;
+        summary << std::fixed << std::setprecision(2) << "Number: " << frame->secretNumber
+            << "   Needed: " << std::log2(static_cast<float>(frame->range)) << " bits"
+            << "   Gained: " << gained << " bits   Best play: " << best << " bits";
+        sf::Text summaryText(summary.str(), ResourceManager::getFont(), rowSize);
+        summaryText.setPosition(50.f * scale, 110.f * scale);
+        summaryText.setFillColor(sf::Color::Yellow);
+        target.draw(summaryText);
+
+        const float columns[] = { 50.f, 110.f, 220.f, 340.f, 470.f, 600.f };
+        const char* headers[] = { "#", "Guess", "Left", "Gained", "Best", "Best guess" };
+        for (int c = 0; c < 6; ++c) {
+            sf::Text header(headers[c], ResourceManager::getFont(), rowSize);
+            header.setPosition(columns[c] * scale, 160.f * scale);
+            header.setFillColor(sf::Color::Cyan);
+            target.draw(header);
+        }
+
+        const float rowHeight = 30.f * scale;
+        const float startY = 195.f * scale;
+        const int maxRows = std::max(1, static_cast<int>((target.getView().getSize().y - 110.f * scale - startY) / rowHeight));
+        const int count = static_cast<int>(frame->analysis.size());
+        const int shown = count > maxRows ? maxRows - 1 : count;
+
+        for (int i = 0; i < shown; ++i) {
+            const GuessAnalysis& entry = frame->analysis[i];
+            std::string cells[6];
+            cells[0] = std::to_string(i + 1);
+            cells[1] = std::to_string(entry.guess);
+            cells[2] = std::to_string(entry.candidatesBefore) + " > " + std::to_string(entry.candidatesAfter);
+            std::ostringstream gainedCell, bestCell;
+            gainedCell << std::fixed << std::setprecision(2) << entry.bitsGained;
+            bestCell << std::fixed << std::setprecision(2) << entry.bestBits;
+            cells[3] = gainedCell.str();
+            cells[4] = bestCell.str();
+            cells[5] = std::to_string(entry.bestGuess);
+
+            sf::Color color = sf::Color::Red;
+            if (entry.bitsGained >= entry.bestBits * 0.9f) color = sf::Color::Green;
+            else if (entry.bitsGained >= entry.bestBits * 0.5f) color = sf::Color::Yellow;
+
+            for (int c = 0; c < 6; ++c) {
+                sf::Text cell(cells[c], ResourceManager::getFont(), rowSize);
+                cell.setPosition(columns[c] * scale, startY + i * rowHeight);
+                cell.setFillColor(c == 3 ? color : sf::Color::White);
+                target.draw(cell);
+            }
+        }
 
-        for (auto& btn : settingsButtons) {
-            btn->draw(*window);
+        if (shown < count) {
+            sf::Text more("+" + std::to_string(count - shown) + " more guesses", ResourceManager::getFont(), rowSize);
+            more.setPosition(columns[0] * scale, startY + shown * rowHeight);
+            more.setFillColor(sf::Color(200, 200, 200));
+            target.draw(more);
         }
     }
+
+    void renderAnalysis() {
+        TraceZone zone("renderAnalysis");
+        AllocationScope scope("renderAnalysis");
+        drawButtons();
+    }
 };
 
-int main() {
+// Runs the rule kernels specialized per difficulty against the runtime
+// reference: the band computation alone over a fixed set of guesses, then whole
+// simulated games, where the random number generator dominates. Results of the
+// two paths must agree.
+void runRulesBenchmark() {
+    const int games = 200000;
+    const int pairs = 1 << 20;
+
+    for (int d = 0; d < DIFFICULTY_COUNT; ++d) {
+        const int range = DIFFICULTY_RULES[d].range;
+        std::mt19937 pairRng(99);
+        std::uniform_int_distribution<int> valueDist(1, range);
+        std::vector<int> distances(pairs);
+        for (int& distance : distances) distance = std::abs(valueDist(pairRng) - valueDist(pairRng));
+
+        auto measureBands = [&](bool specialized, std::int64_t& sum) {
+            auto start = std::chrono::steady_clock::now();
+            if (specialized) {
+                sum = withDifficulty(d, [&](auto level) {
+                    std::int64_t total = 0;
+                    for (int distance : distances) {
+                        total += temperatureBand<DifficultyTraits<decltype(level)::value>::range>(distance);
+                    }
+                    return total;
+                });
+            }
+            else {
+                sum = 0;
+                for (int distance : distances) sum += temperatureBand(distance, range);
+            }
+            auto end = std::chrono::steady_clock::now();
+            return std::chrono::duration<double, std::nano>(end - start).count() / pairs;
+        };
+
+        auto measure = [&](bool specialized, SimulationResult& result) {
+            std::mt19937 rng(1234);
+            auto start = std::chrono::steady_clock::now();
+            if (specialized) {
+                result = withDifficulty(d, [&](auto level) { return simulateGames<decltype(level)::value>(rng, games); });
+            }
+            else {
+                result = simulateGames(d, rng, games);
+            }
+            auto end = std::chrono::steady_clock::now();
+            return std::chrono::duration<double, std::nano>(end - start).count() / result.guesses;
+        };
+
+        std::int64_t runtimeSum = 0;
+        std::int64_t specializedSum = 0;
+        double runtimeBandNs = measureBands(false, runtimeSum);
+        double specializedBandNs = measureBands(true, specializedSum);
+
+        SimulationResult runtime;
+        SimulationResult specialized;
+        double runtimeNs = measure(false, runtime);
+        double specializedNs = measure(true, specialized);
+        bool agree = runtimeSum == specializedSum && runtime.won == specialized.won
+            && runtime.guesses == specialized.guesses && runtime.bands == specialized.bands;
+
+        std::cout << std::left << std::setw(7) << DIFFICULTY_RULES[d].name << std::right << std::fixed << std::setprecision(2)
+            << " bands: runtime " << runtimeBandNs << " ns, specialized " << specializedBandNs << " ns"
+            << " | games (" << runtime.won << "/" << runtime.games << " won): runtime " << runtimeNs
+            << " ns/guess, specialized " << specializedNs << " ns/guess"
+            << (agree ? "" : "  MISMATCH") << std::endl;
+    }
+}
+
+// Open, switch and save cost in a throwaway store holding a busy kiosk's worth of profiles
+void runProfileBenchmark() {
+    const std::string path = "profiles-bench.dat";
+    const int profiles = 50000;
+    const int switches = 10000;
+    std::remove(path.c_str());
+
+    ProfileStore store;
+    if (!store.open(path)) {
+        std::cerr << "Error: Failed to create " << path << std::endl;
+        return;
+    }
+    sf::Int64 start = nowMicros();
+    for (int i = 0; i < profiles; ++i) store.select("player" + std::to_string(i));
+    sf::Int64 createMicros = nowMicros() - start;
+
+    start = nowMicros();
+    ProfileStore reopened;
+    reopened.open(path);
+    sf::Int64 openMicros = nowMicros() - start;
+
+    std::mt19937 rng(7);
+    SaveData data;
+    start = nowMicros();
+    for (int i = 0; i < switches; ++i) {
+        int slot = reopened.select("player" + std::to_string(rng() % profiles));
+        reopened.read(slot, data);
+    }
+    sf::Int64 switchMicros = nowMicros() - start;
+
+    start = nowMicros();
+    for (int i = 0; i < switches; ++i) {
+        data.totalPoints = i;
+        reopened.write(static_cast<int>(rng() % profiles), data);
+    }
+    sf::Int64 writeMicros = nowMicros() - start;
+
+    std::cout << std::fixed << std::setprecision(2) << profiles << " profiles: created in " << createMicros / 1000.0
+        << " ms, opened in " << openMicros / 1000.0 << " ms, switch " << switchMicros * 1000.0 / switches
+        << " ns, save " << writeMicros * 1000.0 / switches << " ns, journal " << reopened.journalSize() << " bytes" << std::endl;
+    std::remove(path.c_str());
+    std::remove((path + ".journal").c_str());
+    std::remove((path + ".journal.old").c_str());
+}
+
+// Texture memory and upload time of the background variant built for each
+// resolution the settings screen offers, plus 1080p for fullscreen
+void runTextureBenchmark() {
+    const sf::Vector2u presets[] = { { 800, 600 }, { 1024, 768 }, { 1280, 720 }, { 1920, 1080 } };
+    ResourceManager::getButtonTexture();
+    for (const sf::Vector2u& preset : presets) {
+        ResourceManager::getBackgroundTexture(preset);
+        std::cout << "preset " << preset.x << "x" << preset.y << std::endl;
+        ResourceManager::reportTextures(std::cout);
+    }
+}
+
+int runBenchmark(const std::string& name) {
+    if (name == "particles") {
+        runParticleBenchmark();
+    }
+    else if (name == "layers") {
+        runLayerBenchmark();
+    }
+    else if (name == "rules") {
+        runRulesBenchmark();
+    }
+    else if (name == "textures") {
+        runTextureBenchmark();
+    }
+    else if (name == "profiles") {
+        runProfileBenchmark();
+    }
+    else if (name == "widgets") {
+        runWidgetBenchmark();
+    }
+    else {
+        std::cerr << "Unknown benchmark: " << name << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
     srand(static_cast<unsigned>(time(nullptr)));
+    FlightRecorder::get().installCrashHandlers(CRASH_FILE.c_str());
+
     try {
-        NumberGuesser game;
+        if (argc > 2 && std::string(argv[1]) == "--bench") {
+            return runBenchmark(argv[2]);
+        }
+
+        // Terminal mode never creates a window or loads a graphics or audio resource
+        if (argc > 1 && std::string(argv[1]) == "--terminal") {
+            std::ios::sync_with_stdio(false);
+            unsigned seed = std::random_device()();
+            if (argc > 3 && std::string(argv[2]) == "--seed") {
+                seed = static_cast<unsigned>(std::stoul(argv[3]));
+            }
+            return TerminalGame(seed).run(std::cin, std::cout);
+        }
+
+        LaunchOptions options;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--threaded") options.threaded = true;
+            else if (arg == "--perf") options.perfReport = true;
+            else if (arg == "--alloc-check") options.allocationCheck = true;
+            else if (arg == "--offscreen") options.offscreen = true;
+            else if (arg == "--capture" && i + 1 < argc) options.captureFile = argv[++i];
+            else if (arg == "--trace" && i + 1 < argc) options.traceFile = argv[++i];
+            else if (arg == "--screen-budget" && i + 1 < argc) {
+                const char* value = argv[++i];
+                char* end = nullptr;
+                unsigned long kib = std::strtoul(value, &end, 10);
+                if (end == value || *end != '\0' || value[0] == '-') {
+                    std::cerr << "Usage: --screen-budget <KiB>, got \"" << value << "\"" << std::endl;
+                    return EXIT_FAILURE;
+                }
+                options.screenBudget = static_cast<std::size_t>(kib) * 1024;
+            }
+            else if (arg == "--eager-screens") options.eagerScreens = true;
+            else if (arg == "--soak" && i + 1 < argc) {
+                // Kiosks run headless for weeks: draw offscreen, e.g. under Xvfb with LIBGL_ALWAYS_SOFTWARE=1
+                options.soakMinutes = std::stod(argv[++i]);
+                options.offscreen = true;
+            }
+            else if (arg == "--soak-tolerance" && i + 1 < argc) options.soakTolerance = std::stod(argv[++i]) / 100.0;
+            else if (arg == "--profile" && i + 1 < argc) options.profile = argv[++i];
+            else if (arg == "--metrics") {
+                options.metricsFile = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : METRICS_FILE;
+            }
+        }
+
+        FlightLogWriter flightLog(FLIGHT_LOG_FILE, std::chrono::milliseconds(500));
+        NumberGuesser game(options);
         game.run();
+        if (!game.soakPassed()) return EXIT_FAILURE;
     }
     catch (const std::exception& e) {
         std::cerr << "Fatal error: " << e.what() << std::endl;
+        FlightRecorder::get().record(FlightRecorder::FAILURE, e.what());
+        FlightRecorder::get().dumpCrash("fatal error");
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;